@@ -0,0 +1,55 @@
+#pragma once
+/**
+ * Хранение результатов маппера в арене задачи.
+ *
+ * Маппер блока складывает ключи и значения в монотонную арену (std::pmr::monotonic_buffer_resource):
+ * память берётся из больших кусков простым сдвигом указателя и освобождается целиком,
+ * когда прогон записан на диск. Строки хранятся в прогоне как std::string_view на арену,
+ * поэтому на запись не выделяется память в куче, а сортировка перемещает только пары указатель/длина.
+ *
+ * Типы, для которых ArenaStorage не специализирован, хранятся как есть.
+ */
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using Arena = std::pmr::monotonic_buffer_resource;
+
+template <typename T>
+struct ArenaStorage
+{
+    using type = T;
+
+    template <typename U>
+    static T store(U&& value, Arena&)
+    {
+        return T(std::forward<U>(value));
+    }
+
+    static const T& load(const T& value)
+    {
+        return value;
+    }
+};
+
+template <>
+struct ArenaStorage<std::string>
+{
+    using type = std::string_view;
+
+    static std::string_view store(std::string_view value, Arena& arena)
+    {
+        if (value.empty())
+            return {};
+        auto data = static_cast<char*>(arena.allocate(value.size(), 1));
+        std::memcpy(data, value.data(), value.size());
+        return std::string_view(data, value.size());
+    }
+
+    static std::string load(std::string_view value)
+    {
+        return std::string(value);
+    }
+};
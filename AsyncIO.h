@@ -0,0 +1,790 @@
+#pragma once
+/**
+ * Асинхронный ввод-вывод для промежуточных файлов.
+ *
+ * IoEngine выполняет запросы чтения и записи по смещению в фоне, а поток задачи ждёт только тогда,
+ * когда ему действительно нужен результат. На Linux запросы отправляются в ядро через io_uring
+ * (системные вызовы напрямую, без liburing), отдельный поток забирает завершения из очереди ядра.
+ * Если io_uring недоступен (старое ядро, запрет в контейнере) или сборка с MAPREDUCE_NO_IO_URING,
+ * запросы выполняют фоновые потоки через pread/pwrite. Под Windows запросы выполняются сразу.
+ *
+ * AsyncFileReader читает файл вперёд двумя буферами: пока разбирается один, в другой уже читается следующий кусок.
+ * Файл, который не удалось открыть (в том числе отсутствующий), - ошибка: промежуточный файл не может пропасть,
+ * и пустым его считать нельзя, иначе потеря данных останется незамеченной, а задача не будет повторена.
+ * AsyncFileWriter пишет с отложенной записью: заполненный буфер уходит на диск, а запись продолжается во второй.
+ */
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(__linux__) && !defined(MAPREDUCE_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#define MAPREDUCE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Запрос чтения или записи size байт по смещению offset
+struct IoRequest
+{
+    int fd = -1;
+    char* buffer = nullptr;
+    size_t size = 0;
+    uint64_t offset = 0;
+    bool write = false;
+
+    // результат: число байт или -errno
+    int64_t result = 0;
+    bool done = true;
+    // завершение запроса будит только его владельца
+    std::mutex mutex;
+    std::condition_variable signal;
+#ifndef _WIN32
+    struct iovec iov;
+#endif
+};
+
+namespace async_io
+{
+    // Синхронное выполнение запроса целиком (короткие чтения и записи продолжаются)
+    inline int64_t perform(const IoRequest& request)
+    {
+        size_t transferred = 0;
+        while (transferred < request.size)
+        {
+#ifdef _WIN32
+            if (::_lseeki64(request.fd, static_cast<__int64>(request.offset + transferred), SEEK_SET) < 0)
+                return -errno;
+            auto chunk = static_cast<unsigned>(std::min<size_t>(request.size - transferred, 1u << 30));
+            auto n = request.write ? ::_write(request.fd, request.buffer + transferred, chunk)
+                                   : ::_read(request.fd, request.buffer + transferred, chunk);
+#else
+            auto n = request.write ? ::pwrite(request.fd, request.buffer + transferred, request.size - transferred, static_cast<off_t>(request.offset + transferred))
+                                   : ::pread(request.fd, request.buffer + transferred, request.size - transferred, static_cast<off_t>(request.offset + transferred));
+#endif
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -errno;
+            }
+            if (n == 0)
+                break;
+            transferred += static_cast<size_t>(n);
+        }
+        return static_cast<int64_t>(transferred);
+    }
+}
+
+class IoEngine
+{
+public:
+    virtual ~IoEngine() = default;
+
+    // Если запрос не удалось отправить, он завершается с ошибкой (wait не зависает), а исключение пробрасывается дальше
+    void submit(IoRequest& request)
+    {
+        start(request);
+        try
+        {
+            dispatch(request);
+        }
+        catch (const std::system_error& e)
+        {
+            complete(request, -e.code().value());
+            throw;
+        }
+        catch (...)
+        {
+            complete(request, -EIO);
+            throw;
+        }
+    }
+
+    // Ждёт завершения запроса и возвращает его результат
+    static int64_t wait(IoRequest& request)
+    {
+        std::unique_lock<std::mutex> lock(request.mutex);
+        request.signal.wait(lock, [&request] { return request.done; });
+        return request.result;
+    }
+
+    // Общий движок процесса: io_uring, если он доступен, иначе фоновые потоки. Создаётся при первом обращении
+    static IoEngine& instance();
+
+    /**
+     * Останавливает и разрушает движок процесса, следующий instance() создаст новый.
+     * Вызывается перед fork (см. LocalCluster.h): в дочернем процессе не остаётся ни копии движка без его потоков,
+     * ни кольца io_uring, общего с родителем. Вызывающий гарантирует, что никто не выполняет запросы
+     * и не держит ссылку на движок (открытых AsyncFileReader и AsyncFileWriter нет).
+     */
+    static void shutdown();
+
+protected:
+    virtual void dispatch(IoRequest& request) = 0;
+
+    static void complete(IoRequest& request, int64_t result)
+    {
+        std::lock_guard<std::mutex> lock(request.mutex);
+        request.result = result;
+        request.done = true;
+        //под мьютексом: проснувшийся владелец может сразу освободить запрос
+        request.signal.notify_one();
+    }
+
+private:
+    static void start(IoRequest& request)
+    {
+        std::lock_guard<std::mutex> lock(request.mutex);
+        request.done = false;
+    }
+
+    struct Holder
+    {
+        std::mutex mutex;
+        std::unique_ptr<IoEngine> engine;
+    };
+
+    static std::unique_ptr<IoEngine> create();
+    static Holder& holder();
+};
+
+// Запросы выполняются фоновыми потоками через pread/pwrite
+class ThreadIoEngine : public IoEngine
+{
+public:
+    explicit ThreadIoEngine(size_t threads_count = 2)
+    {
+        for (size_t i = 0; i < threads_count; ++i)
+            threads.emplace_back(&ThreadIoEngine::worker_loop, this);
+    }
+
+    ~ThreadIoEngine() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stop = true;
+        }
+        queue_cv.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+protected:
+    void dispatch(IoRequest& request) override
+    {
+#ifdef _WIN32
+        complete(request, async_io::perform(request));
+#else
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue.push_back(&request);
+        }
+        queue_cv.notify_one();
+#endif
+    }
+
+private:
+    void worker_loop()
+    {
+        while (true)
+        {
+            IoRequest* request;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [this] { return stop || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                request = queue.front();
+                queue.pop_front();
+            }
+            complete(*request, async_io::perform(*request));
+        }
+    }
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<IoRequest*> queue;
+    bool stop = false;
+    std::vector<std::thread> threads;
+};
+
+#ifdef MAPREDUCE_IO_URING
+/**
+ * Кольца io_uring: очередь отправки (SQ) заполняется под мьютексом и сразу отдаётся ядру,
+ * очередь завершений (CQ) разбирает отдельный поток. Чтение и запись - IORING_OP_READV/WRITEV (ядро 5.1+).
+ *
+ * Запросов в полёте не больше, чем мест в CQ: отправитель ждёт, пока поток завершений освободит место.
+ * Нужен IORING_FEAT_NODROP (ядро 5.5+), без него ядро при переполнении CQ теряет завершения.
+ */
+class UringIoEngine : public IoEngine
+{
+public:
+    // Бросает std::system_error, если io_uring недоступен
+    explicit UringIoEngine(unsigned entries = 256)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd < 0)
+            throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+#ifdef IORING_FEAT_NODROP
+        if ((params.features & IORING_FEAT_NODROP) == 0)
+#endif
+        {
+            ::close(ring_fd);
+            throw std::system_error(ENOTSUP, std::generic_category(), "io_uring without IORING_FEAT_NODROP");
+        }
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+        sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+        cq_ring = single_mmap ? sq_ring : map(cq_ring_size, IORING_OFF_CQ_RING);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(map(sqes_size, IORING_OFF_SQES));
+
+        auto sq = static_cast<char*>(sq_ring);
+        sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<char*>(cq_ring);
+        cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cq_entries = params.cq_entries;
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        completion_thread = std::thread(&UringIoEngine::completion_loop, this);
+    }
+
+    ~UringIoEngine() override
+    {
+        //пустой запрос без адреса будит поток завершений и останавливает его
+        try
+        {
+            push(IORING_OP_NOP, -1, nullptr, 0, nullptr);
+        }
+        catch (const std::system_error&)
+        {
+            //поток завершений уже остановлен ошибкой кольца
+        }
+        completion_thread.join();
+
+        ::munmap(sqes, sqes_size);
+        if (!single_mmap)
+            ::munmap(cq_ring, cq_ring_size);
+        ::munmap(sq_ring, sq_ring_size);
+        ::close(ring_fd);
+    }
+
+protected:
+    void dispatch(IoRequest& request) override
+    {
+        request.iov.iov_base = request.buffer;
+        request.iov.iov_len = request.size;
+        push(request.write ? IORING_OP_WRITEV : IORING_OP_READV, request.fd, &request.iov, request.offset, &request);
+    }
+
+private:
+    void* map(size_t size, uint64_t offset)
+    {
+        void* addr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, static_cast<off_t>(offset));
+        if (addr == MAP_FAILED)
+        {
+            auto err = errno;
+            ::close(ring_fd);
+            throw std::system_error(err, std::generic_category(), "io_uring mmap");
+        }
+        return addr;
+    }
+
+    void push(uint8_t opcode, int fd, const struct iovec* iov, uint64_t offset, IoRequest* request)
+    {
+        {
+            std::unique_lock<std::mutex> lock(slots_mutex);
+            //пустой запрос остановки места не ждёт: с NODROP лишнее завершение ядро не теряет
+            slots_cv.wait(lock, [this, request] { return failure != 0 || request == nullptr || pending.size() < cq_entries; });
+            if (failure != 0)
+                throw std::system_error(failure, std::generic_category(), "io_uring");
+            if (request != nullptr)
+                pending.insert(request);
+        }
+
+        try
+        {
+            //очередь отправки могут занять запросы, которые другие потоки ещё не отдали ядру
+            while (!enqueue(opcode, fd, iov, offset, reinterpret_cast<uint64_t>(request)))
+                enter(sq_entries);
+            enter(1);
+        }
+        catch (...)
+        {
+            //завершение такого запроса, если оно всё же придёт, поток завершений пропустит
+            if (request != nullptr)
+                release(request);
+            throw;
+        }
+    }
+
+    // Кладёт запрос в очередь отправки; false - очередь заполнена
+    bool enqueue(uint8_t opcode, int fd, const struct iovec* iov, uint64_t offset, uint64_t user_data)
+    {
+        std::lock_guard<std::mutex> lock(submit_mutex);
+        auto tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries)
+            return false;
+        auto index = tail & sq_mask;
+        auto& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len = iov != nullptr ? 1 : 0;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Отдаёт ядру до count запросов очереди отправки. Вызывается без мьютексов: ядро может ждать места в CQ
+    void enter(unsigned count)
+    {
+        while (::syscall(__NR_io_uring_enter, ring_fd, count, 0, 0, nullptr, 0) < 0)
+        {
+            if (errno == EAGAIN || errno == EBUSY)
+                std::this_thread::yield();
+            else if (errno != EINTR)
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+        }
+    }
+
+    // Снимает запрос с учёта; false - запрос уже завершён с ошибкой
+    bool release(IoRequest* request)
+    {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        return pending.erase(request) != 0;
+    }
+
+    void completion_loop()
+    {
+        while (true)
+        {
+            if (::syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            {
+                fail(errno);
+                return;
+            }
+
+            //запросы заполняются до публикации sq_tail (release в enqueue), эта загрузка упорядочивает их чтение здесь
+            static_cast<void>(__atomic_load_n(sq_tail, __ATOMIC_ACQUIRE));
+            auto head = *cq_head;
+            auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            bool stop = false;
+            for (; head != tail; ++head)
+            {
+                const auto& cqe = cqes[head & cq_mask];
+                auto request = reinterpret_cast<IoRequest*>(cqe.user_data);
+                if (request == nullptr)
+                    stop = true;
+                else if (release(request))
+                    finish(*request, cqe.res);
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            slots_cv.notify_all();
+            if (stop)
+                return;
+        }
+    }
+
+    // Кольцо неработоспособно: запросы в полёте завершаются с ошибкой, новые отклоняются
+    void fail(int error)
+    {
+        std::unordered_set<IoRequest*> failed;
+        {
+            std::lock_guard<std::mutex> lock(slots_mutex);
+            failure = error;
+            failed.swap(pending);
+        }
+        slots_cv.notify_all();
+        for (auto request : failed)
+            complete(*request, -error);
+    }
+
+    void finish(IoRequest& request, int32_t res)
+    {
+        //ядро может выполнить запрос не полностью - остаток дописываем (дочитываем) синхронно
+        if (res >= 0 && static_cast<size_t>(res) < request.size)
+        {
+            IoRequest rest;
+            rest.fd = request.fd;
+            rest.buffer = request.buffer + res;
+            rest.size = request.size - static_cast<size_t>(res);
+            rest.offset = request.offset + static_cast<uint64_t>(res);
+            rest.write = request.write;
+            auto more = async_io::perform(rest);
+            complete(request, more < 0 ? more : res + more);
+            return;
+        }
+        complete(request, res);
+    }
+
+    int ring_fd = -1;
+    bool single_mmap = false;
+    void* sq_ring = nullptr;
+    void* cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    unsigned cq_entries = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    std::mutex submit_mutex;
+
+    // запросы, отправленные ядру и ещё не завершённые
+    std::mutex slots_mutex;
+    std::condition_variable slots_cv;
+    std::unordered_set<IoRequest*> pending;
+    int failure = 0;
+
+    std::thread completion_thread;
+};
+#endif
+
+inline std::unique_ptr<IoEngine> IoEngine::create()
+{
+#ifdef MAPREDUCE_IO_URING
+    try
+    {
+        return std::make_unique<UringIoEngine>();
+    }
+    catch (const std::system_error&)
+    {
+    }
+#endif
+    return std::make_unique<ThreadIoEngine>();
+}
+
+inline IoEngine::Holder& IoEngine::holder()
+{
+    static Holder holder;
+    return holder;
+}
+
+inline IoEngine& IoEngine::instance()
+{
+    auto& state = holder();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.engine)
+        state.engine = create();
+    return *state.engine;
+}
+
+inline void IoEngine::shutdown()
+{
+    auto& state = holder();
+    std::unique_ptr<IoEngine> engine;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        engine = std::move(state.engine);
+    }
+    //движок разрушается после снятия блокировки: деструктор ждёт завершения его потоков
+}
+
+namespace async_io
+{
+    constexpr size_t default_chunk_size = 256 * 1024;
+
+    inline int open_file(const std::string& fname, bool write)
+    {
+#ifdef _WIN32
+        return write ? ::_open(fname.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+                     : ::_open(fname.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        return write ? ::open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                     : ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+    }
+
+    inline void close_file(int fd)
+    {
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    // Буфер с запросом. Хранится по указателю, чтобы адрес запроса не менялся при перемещении файла
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data;
+        IoRequest request;
+    };
+}
+
+/**
+ * Последовательное чтение файла с опережением на один кусок.
+ * Отсутствующий файл читается как пустой, как и std::ifstream, который использовался раньше.
+ */
+class AsyncFileReader
+{
+public:
+    explicit AsyncFileReader(const std::string& fname, size_t _chunk_size = async_io::default_chunk_size)
+        : chunk_size(_chunk_size), engine(&IoEngine::instance())
+    {
+        fd = async_io::open_file(fname, false);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), fname);
+        for (auto& chunk : chunks)
+        {
+            chunk = std::make_unique<async_io::Chunk>();
+            chunk->data.reset(new char[chunk_size]);
+        }
+        //сразу читаем два первых куска
+        try
+        {
+            request_next(*chunks[0]);
+            request_next(*chunks[1]);
+        }
+        catch (...)
+        {
+            //буферы освобождаются только после отправленного чтения
+            for (auto& chunk : chunks)
+                engine->wait(chunk->request);
+            async_io::close_file(fd);
+            throw;
+        }
+    }
+
+    ~AsyncFileReader()
+    {
+        if (fd < 0)
+            return;
+        for (auto& chunk : chunks)
+            if (chunk)
+                engine->wait(chunk->request);
+        async_io::close_file(fd);
+    }
+
+    AsyncFileReader(AsyncFileReader&& other) noexcept
+        : chunk_size(other.chunk_size), engine(other.engine), fd(std::exchange(other.fd, -1)),
+          chunks{ std::move(other.chunks[0]), std::move(other.chunks[1]) }, current(other.current),
+          started(other.started), eof(other.eof), next_offset(other.next_offset), position(other.position), available(other.available)
+    {
+
+    }
+
+    // Читает до size байт в dst, возвращает прочитанное количество (меньше size - конец файла)
+    size_t read(char* dst, size_t size)
+    {
+        size_t copied = 0;
+        while (copied < size && fd >= 0)
+        {
+            if (position == available)
+            {
+                if (!next_chunk())
+                    break;
+                continue;
+            }
+            auto n = std::min(size - copied, available - position);
+            std::memcpy(dst + copied, chunks[current]->data.get() + position, n);
+            position += n;
+            copied += n;
+        }
+        return copied;
+    }
+
+private:
+    void request_next(async_io::Chunk& chunk)
+    {
+        chunk.request.fd = fd;
+        chunk.request.buffer = chunk.data.get();
+        chunk.request.size = chunk_size;
+        chunk.request.offset = next_offset;
+        chunk.request.write = false;
+        next_offset += chunk_size;
+        engine->submit(chunk.request);
+    }
+
+    // Переключается на следующий прочитанный кусок и заказывает чтение на место текущего
+    bool next_chunk()
+    {
+        if (eof)
+            return false;
+        if (started)
+        {
+            request_next(*chunks[current]);
+            current ^= 1;
+        }
+        started = true;
+
+        auto result = engine->wait(chunks[current]->request);
+        if (result < 0)
+            throw std::system_error(static_cast<int>(-result), std::generic_category(), "read spill file");
+        position = 0;
+        available = static_cast<size_t>(result);
+        eof = available < chunk_size;
+        return available != 0;
+    }
+
+    size_t chunk_size;
+    IoEngine* engine;
+    int fd = -1;
+    std::unique_ptr<async_io::Chunk> chunks[2];
+    size_t current = 0;
+    bool started = false;
+    bool eof = false;
+    uint64_t next_offset = 0;
+    size_t position = 0;
+    size_t available = 0;
+};
+
+/**
+ * Последовательная запись файла с отложенной записью: полный буфер отправляется на диск,
+ * а данные продолжают копироваться во второй буфер. Ожидание - только если диск отстал на целый буфер.
+ */
+class AsyncFileWriter
+{
+public:
+    explicit AsyncFileWriter(const std::string& _fname, size_t _chunk_size = async_io::default_chunk_size)
+        : fname(_fname), chunk_size(_chunk_size), engine(&IoEngine::instance())
+    {
+        fd = async_io::open_file(fname, true);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), fname);
+        for (auto& chunk : chunks)
+        {
+            chunk = std::make_unique<async_io::Chunk>();
+            chunk->data.reset(new char[chunk_size]);
+        }
+    }
+
+    ~AsyncFileWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    AsyncFileWriter(AsyncFileWriter&& other) noexcept
+        : fname(std::move(other.fname)), chunk_size(other.chunk_size), engine(other.engine), fd(std::exchange(other.fd, -1)),
+          chunks{ std::move(other.chunks[0]), std::move(other.chunks[1]) }, current(other.current), filled(other.filled), offset(other.offset)
+    {
+
+    }
+
+    void write(const char* data, size_t size)
+    {
+        while (size != 0)
+        {
+            auto n = std::min(size, chunk_size - filled);
+            std::memcpy(chunks[current]->data.get() + filled, data, n);
+            filled += n;
+            data += n;
+            size -= n;
+            if (filled == chunk_size)
+                flush_chunk();
+        }
+    }
+
+    bool is_open() const
+    {
+        return fd >= 0;
+    }
+
+    void close()
+    {
+        if (fd < 0)
+            return;
+        flush_chunk();
+        int64_t error = 0;
+        for (auto& chunk : chunks)
+        {
+            auto result = engine->wait(chunk->request);
+            if (result < 0 || static_cast<size_t>(result) != chunk->request.size)
+                error = result < 0 ? result : -EIO;
+            chunk->request.size = 0;
+            chunk->request.result = 0;
+        }
+        async_io::close_file(fd);
+        fd = -1;
+        if (error != 0)
+            throw std::system_error(static_cast<int>(-error), std::generic_category(), fname);
+    }
+
+private:
+    void flush_chunk()
+    {
+        if (filled == 0)
+            return;
+        auto& chunk = *chunks[current];
+        chunk.request.fd = fd;
+        chunk.request.buffer = chunk.data.get();
+        chunk.request.size = filled;
+        chunk.request.offset = offset;
+        chunk.request.write = true;
+        engine->submit(chunk.request);
+        offset += filled;
+        filled = 0;
+
+        //второй буфер можно заполнять, когда его предыдущая запись закончилась
+        current ^= 1;
+        auto& next = *chunks[current];
+        auto result = engine->wait(next.request);
+        if (result < 0 || static_cast<size_t>(result) != next.request.size)
+            throw std::system_error(result < 0 ? static_cast<int>(-result) : EIO, std::generic_category(), fname);
+    }
+
+    std::string fname;
+    size_t chunk_size;
+    IoEngine* engine;
+    int fd = -1;
+    std::unique_ptr<async_io::Chunk> chunks[2];
+    size_t current = 0;
+    size_t filled = 0;
+    uint64_t offset = 0;
+};
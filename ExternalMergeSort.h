@@ -6,176 +6,363 @@ https://www.techiedelight.com/ru/external-merge-sort/
 -    (, )   ;
 -  fstream   FILE*;
 -    (        ).
--  createInitialRuns   MapReduceFramework   , ..    mappper_count    Map
+-  createInitialRuns    :         .
+-  std::priority_queue       (LoserTree)   ,
+        ,         -.
+-    createInitialRuns    (,      KeySort.h).
+-   mergeFiles    check (,   ),    -   publish.
 */
 
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
 #include <algorithm>
-#include <queue>
-#include <limits>
 #include <vector>
+#include <functional>
+#include <memory>
 
+//     .     -    .
+//         open_reader/open_writer,
+//     read(T&)  write(const T&) .
 template <typename T>
-struct MinHeapNode
+struct LineIO
 {
-    //   
-    T element;
+    //     
+    static constexpr size_t buffer_size = 1 << 20;
 
-    //  ,    
-    int i=0;
-};
+    class Reader
+    {
+    public:
+        explicit Reader(const std::string& fname)
+            : buffer(new char[buffer_size]), in(std::make_unique<std::ifstream>())
+        {
+            //     ,     
+            in->rdbuf()->pubsetbuf(buffer.get(), buffer_size);
+            in->open(fname);
+        }
 
-//  ,      
-template <typename T>
-struct comp
-{
-    bool operator()(const MinHeapNode<T>& lhs, const MinHeapNode<T>& rhs) const 
+        bool read(T& element)
+        {
+            return static_cast<bool>(std::getline(*in, element));
+        }
+
+    private:
+        std::unique_ptr<char[]> buffer;
+        std::unique_ptr<std::ifstream> in;
+    };
+
+    class Writer
+    {
+    public:
+        explicit Writer(const std::string& fname)
+            : buffer(new char[buffer_size]), out(std::make_unique<std::ofstream>())
+        {
+            out->rdbuf()->pubsetbuf(buffer.get(), buffer_size);
+            out->open(fname);
+        }
+
+        void write(const T& element)
+        {
+            *out << element << '\n';
+        }
+
+        void close()
+        {
+            out->close();
+        }
+
+    private:
+        std::unique_ptr<char[]> buffer;
+        std::unique_ptr<std::ofstream> out;
+    };
+
+    Reader open_reader(const std::string& fname) const
+    {
+        return Reader(fname);
+    }
+
+    Writer open_writer(const std::string& fname) const
     {
-        return lhs.element > rhs.element;
+        return Writer(fname);
     }
 };
 
-//  `k`  . ,    <input_filename_prefix>_(1, 2,  `k`)
+//     :  next      accumulated
+// ( -  ),   next  accumulated   true
 template <typename T>
-void mergeFiles(const std::string& output_file, const std::string& input_filename_prefix, size_t k)
+using MergeCombiner = std::function<bool(T& accumulated, const T& next)>;
+
+/**
+ *   ( )  k- .
+ *
+ *  -    read(T&),     .
+ *        ,  tree[0] -   ().
+ *              :
+ * log2(k)         .
+ *    ,  -  .
+ *       , ..  .
+ */
+template <typename T, typename Source, typename Less = std::less<T>>
+class LoserTree
 {
-    std::vector<std::ifstream> in;
-    in.reserve(k);
-    for (int i = 0; i < k; i++)
+public:
+    explicit LoserTree(std::vector<Source> _sources, Less _less = Less{})
+        : sources(std::move(_sources)), less(std::move(_less)), k(sources.size()),
+          values(k), alive(k, false), tree(std::max<size_t>(k, 1), minus_infinity())
     {
-        //      
-        in.emplace_back(input_filename_prefix + "_" + std::to_string(i));
+        for (size_t i = 0; i < k; ++i)
+            alive[i] = sources[i].read(values[i]);
+        for (size_t i = k; i-- > 0;)
+            adjust(i);
     }
 
-    // 
-    std::ofstream out(output_file);
+    bool empty() const
+    {
+        return k == 0 || !alive[tree[0]];
+    }
+
+    //  .       pop
+    T& top()
+    {
+        return values[tree[0]];
+    }
+
+    //  ,     
+    size_t top_source() const
+    {
+        return tree[0];
+    }
+
+    //        
+    void pop()
+    {
+        auto winner = tree[0];
+        alive[winner] = sources[winner].read(values[winner]);
+        adjust(winner);
+    }
 
-    //  -  `k`  .     
-    //    
-    std::vector<MinHeapNode<T>> harr;
-    harr.reserve(k);
-    std::priority_queue<MinHeapNode<T>, std::vector<MinHeapNode<T>>, comp<T>> pq;
+private:
+    //  ,     -     
+    size_t minus_infinity() const
+    {
+        return k;
+    }
 
-    int i;
-    for (i = 0; i < k; i++)
+    bool beats(size_t lhs, size_t rhs) const
     {
-        // ,      
-        //  `i`    
-        MinHeapNode<T> node;
-        harr.emplace_back(std::move(node));
+        if (lhs == minus_infinity())
+            return true;
+        if (rhs == minus_infinity())
+            return false;
+        if (!alive[lhs])
+            return false;
+        if (!alive[rhs])
+            return true;
+        if (less(values[lhs], values[rhs]))
+            return true;
+        if (less(values[rhs], values[lhs]))
+            return false;
+        return lhs < rhs;
+    }
 
-        T data;
-        if (!std::getline(in[i], data))
+    //    source    
+    void adjust(size_t source)
+    {
+        auto winner = source;
+        for (auto node = (source + k) / 2; node > 0; node /= 2)
         {
-            break;
+            if (beats(tree[node], winner))
+                std::swap(tree[node], winner);
         }
-        harr[i].element = data;
+        tree[0] = winner;
+    }
+
+    std::vector<Source> sources;
+    Less less;
+    size_t k;
+    std::vector<T> values;
+    std::vector<bool> alive;
+    std::vector<size_t> tree;
+};
+
+/**
+ *           read(T&).
+ *     ,         .
+ *   combine,        .
+ */
+template <typename T, typename Source, typename Less = std::less<T>>
+class MergedReader
+{
+public:
+    explicit MergedReader(std::vector<Source> sources, MergeCombiner<T> _combine = {}, Less less = Less{})
+        : tree(std::move(sources), std::move(less)), combine(std::move(_combine))
+    {
 
-        //    
-        harr[i].i = i;
-        pq.push(harr[i]);
     }
 
-    auto default_element = std::numeric_limits<T>::max();
-    do
+    bool read(T& element)
     {
-        int count = 0;
-        //           
-        //    .    ,        EOF.
-        while (count != i)
-        {
-            //         
-            MinHeapNode<T> root = pq.top();
-            pq.pop();
-            out << root.element;
-
-            //   ,      .
-            //       ,     .
-            if (!std::getline(in[root.i], root.element))
-            {
-                root.element = default_element;
-                count++;
-            }
-            if (count != i)
-                out << std::endl;
+        if (tree.empty())
+            return false;
 
-            //      
-            if (root.element != default_element)
+        element = std::move(tree.top());
+        tree.pop();
+        ++consumed;
+        if (combine)
+        {
+            while (!tree.empty() && combine(element, tree.top()))
             {
-                pq.push(root);
+                tree.pop();
+                ++consumed;
             }
         }
+        return true;
     }
-    while (!pq.empty());
 
-    //     
-    for (int i = 0; i < k; i++) 
+    //      ( combine - ,   read)
+    uint64_t consumed_count() const
     {
-        in[i].close();
+        return consumed;
     }
 
-    out.close();
+private:
+    LoserTree<T, Source, Less> tree;
+    MergeCombiner<T> combine;
+    uint64_t consumed = 0;
+};
+
+//       
+template <typename IO>
+auto openReaders(const std::vector<std::string>& input_files, const IO& io)
+{
+    std::vector<decltype(io.open_reader(std::string()))> readers;
+    readers.reserve(input_files.size());
+    for (const auto& fname : input_files)
+        readers.emplace_back(io.open_reader(fname));
+    return readers;
 }
 
-//    ,      
-//    
-template <typename T>
-void createInitialRuns(const std::string& input_file, int run_size, int num_ways)
+//    :     
+using MergeCheck = std::function<void()>;
+
+//   :  ,   ,   
+// (,   )     -    
+using MergePublish = std::function<void(const std::function<void()>& close)>;
+
+//   :        
+struct MergeCounts
+{
+    uint64_t elements_in = 0;
+    uint64_t elements_out = 0;
+};
+
+//      input_files     output_file.
+//   combine,         .
+//   check,     check_period      .
+//   publish,     .
+template <typename T, typename IO = LineIO<T>, typename Less = std::less<T>>
+MergeCounts mergeFiles(const std::string& output_file, const std::vector<std::string>& input_files, const MergeCombiner<T>& combine = {}, const IO& io = IO{},
+                const MergeCheck& check = {}, const MergePublish& publish = {})
 {
-    //    
-    std::ifstream in(input_file);
+    constexpr size_t check_period = 4096;
+
+    using Reader = decltype(io.open_reader(std::string()));
+    MergedReader<T, Reader, Less> in(openReaders(input_files, io), combine);
+
+    // 
+    auto out = io.open_writer(output_file);
 
-    //   
-    std::vector<std::ofstream> out;
-    out.reserve(num_ways);
-    for (int i = 0; i < num_ways; i++)
+    MergeCounts counts;
+    T element;
+    for (; in.read(element); ++counts.elements_out)
     {
-        //      
-        out.emplace_back(std::to_string(i));
+        if (check && counts.elements_out % check_period == 0)
+            check();
+        out.write(element);
     }
 
-    //   ,     
-    //  `run_size`
-    std::vector<T> arr;
-    arr.reserve(run_size);
+    if (check)
+        check();
+    if (publish)
+        publish([&out] { out.close(); });
+    else
+        out.close();
+    counts.elements_in = in.consumed_count();
+    return counts;
+}
+
+//  ,     (    )
+template <typename T>
+size_t memory_usage(const T&)
+{
+    return sizeof(T);
+}
+
+inline size_t memory_usage(const std::string& str)
+{
+    //          
+    auto data = reinterpret_cast<const char*>(str.data());
+    auto object = reinterpret_cast<const char*>(&str);
+    bool small = data >= object && data < object + sizeof(str);
+    return sizeof(str) + (small ? 0 : str.capacity() + 1);
+}
+
+//   :     
+inline size_t memory_usage(std::string_view str)
+{
+    return sizeof(str) + str.size();
+}
 
-    bool more_input = true;
-    int next_output_file = 0;
+template <typename A, typename B>
+size_t memory_usage(const std::pair<A, B>& pair)
+{
+    return memory_usage(pair.first) + memory_usage(pair.second);
+}
 
-    int i;
-    while (more_input)
+//    
+struct StdSort
+{
+    template <typename T, typename Less>
+    void operator()(std::vector<T>& run, Less less) const
     {
-        //   `run_size`  `arr`   
-        for (i = 0; i < run_size; i++)
-        {
-            T data;
-            if (!std::getline(in, data))
-            {
-                more_input = false;
-                break;
-            }
-            arr.emplace_back(data);
-        }
+        std::sort(run.begin(), run.end(), less);
+    }
+};
 
-        //    run_size 
-        std::sort(arr.begin(), arr.end());
+//    ,     .
+//   read(T&),    false.
+//       memory_budget ,    
+//  write_run(std::vector<T>& run, size_t run_number, T* next),      .
+//      : next -      ,
+// nullptr -  .  write_run    , next  .
+//  std::sort     sort(std::vector<T>& run, Less less).
+//   .   ,     .
+template <typename T, typename Less = std::less<T>, typename Sort = StdSort, typename Read, typename WriteRun>
+size_t createInitialRuns(Read&& read, size_t memory_budget, WriteRun&& write_run, Less less = Less{}, Sort sort = Sort{})
+{
+    std::vector<T> arr;
+    T next;
+    bool has_next = read(next);
 
-        //       
-        for (int j = 0; j < i; j++) 
+    size_t next_run = 0;
+    do
+    {
+        //    `arr`,     
+        size_t used = 0;
+        while (has_next && (used < memory_budget || arr.empty()))
         {
-            out[next_output_file] << arr[j];
-            if (j!=i-1)
-                out[next_output_file] << std::endl;
+            used += memory_usage(next);
+            arr.emplace_back(std::move(next));
+            has_next = read(next);
         }
-        arr.clear();
-        next_output_file++;
-    }
 
-    //     
-    for (int i = 0; i < num_ways; i++) 
-    {
-        out[i].close();
-    }
+        //       
+        sort(arr, less);
+        write_run(arr, next_run, has_next ? &next : nullptr);
+        arr.clear();
+        next_run++;
+    } while (has_next);
 
-    in.close();
-}
\ No newline at end of file
+    return next_run;
+}
@@ -0,0 +1,85 @@
+#pragma once
+/**
+ * Список входных файлов задачи.
+ *
+ * Вход задаётся путями, каждый из которых может быть:
+ *   - файлом;
+ *   - каталогом - берутся все обычные файлы каталога (без подкаталогов);
+ *   - шаблоном имени с * и ? в последнем компоненте пути, например logs/app.log.*.
+ * Файлы каталога и шаблона упорядочиваются по имени, чтобы разбиение на блоки не зависело от порядка обхода каталога.
+ */
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace input_files
+{
+    // Сопоставление имени с шаблоном: * - любая последовательность символов, ? - один символ
+    inline bool match_wildcard(std::string_view pattern, std::string_view name)
+    {
+        size_t p = 0, n = 0;
+        //позиция последней * в шаблоне и место в имени, с которого она сейчас поглощает символы
+        size_t star = std::string_view::npos, star_match = 0;
+        while (n < name.size())
+        {
+            if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+            {
+                ++p;
+                ++n;
+            }
+            else if (p < pattern.size() && pattern[p] == '*')
+            {
+                star = p++;
+                star_match = n;
+            }
+            else if (star != std::string_view::npos)
+            {
+                p = star + 1;
+                n = ++star_match;
+            }
+            else
+                return false;
+        }
+        while (p < pattern.size() && pattern[p] == '*')
+            ++p;
+        return p == pattern.size();
+    }
+
+    inline bool is_wildcard(const std::filesystem::path& path)
+    {
+        return path.filename().string().find_first_of("*?") != std::string::npos;
+    }
+
+    // Обычные файлы каталога directory, имена которых подходят под pattern, по возрастанию имён
+    inline std::vector<std::filesystem::path> list_directory(const std::filesystem::path& directory, std::string_view pattern = "*")
+    {
+        std::vector<std::filesystem::path> files;
+        for (const auto& entry : std::filesystem::directory_iterator(directory.empty() ? std::filesystem::path(".") : directory))
+        {
+            if (entry.is_regular_file() && match_wildcard(pattern, entry.path().filename().string()))
+                files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+}
+
+// Раскрывает каталоги и шаблоны в список файлов, сохраняя порядок путей
+inline std::vector<std::filesystem::path> expand_input_paths(const std::vector<std::filesystem::path>& paths)
+{
+    std::vector<std::filesystem::path> files;
+    for (const auto& path : paths)
+    {
+        std::vector<std::filesystem::path> expanded;
+        if (std::filesystem::is_directory(path))
+            expanded = input_files::list_directory(path);
+        else if (input_files::is_wildcard(path) && !std::filesystem::exists(path))
+            expanded = input_files::list_directory(path.parent_path(), path.filename().string());
+        else
+            expanded.push_back(path);
+        std::move(expanded.begin(), expanded.end(), std::back_inserter(files));
+    }
+    return files;
+}
@@ -0,0 +1,155 @@
+#pragma once
+/**
+ * Сортировка записей со строковыми ключами по кэшированному префиксу ключа.
+ *
+ * Первые 8 байт ключа упаковываются в число (старший байт - первый символ), так что сравнение чисел
+ * совпадает с лексикографическим сравнением этих байт. Сортируются пары (префикс, номер записи):
+ * все сравнения - сравнения чисел в непрерывном массиве, без перехода по указателям к строкам.
+ * Записи с совпавшими префиксами досортировываются по следующим 8 байтам ключа и т.д.
+ * Записи переставляются один раз в конце.
+ *
+ * Первый проход - поразрядная (MSD) раскладка по первому байту ключа на 256 корзин.
+ * Корзины независимы, поэтому при передаче пула потоков большие корзины сортируются параллельно.
+ *
+ * Для ключей, которые не являются строками, используется std::sort.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace key_sort
+{
+    // Байты строки [depth, depth + 8) как число, недостающие байты - нули
+    inline uint64_t key_prefix(std::string_view key, size_t depth)
+    {
+        uint64_t prefix = 0;
+        auto size = key.size() > depth ? std::min<size_t>(key.size() - depth, sizeof(prefix)) : 0;
+        for (size_t i = 0; i < size; ++i)
+            prefix |= static_cast<uint64_t>(static_cast<unsigned char>(key[depth + i])) << (8 * (sizeof(prefix) - 1 - i));
+        return prefix;
+    }
+
+    struct Entry
+    {
+        uint64_t prefix;
+        uint32_t index;
+        // сколько байт ключа осталось с позиции depth: 0..8, или 9, если ключ длиннее
+        uint32_t rest;
+
+        bool operator<(const Entry& rhs) const
+        {
+            return prefix != rhs.prefix ? prefix < rhs.prefix : rest < rhs.rest;
+        }
+    };
+
+    inline Entry make_entry(std::string_view key, uint32_t index, size_t depth)
+    {
+        auto rest = key.size() > depth ? std::min<size_t>(key.size() - depth, sizeof(uint64_t) + 1) : 0;
+        return Entry{ key_prefix(key, depth), index, static_cast<uint32_t>(rest) };
+    }
+
+    // корзины меньше этого размера не стоит отдавать в отдельные задачи
+    constexpr size_t parallel_bucket_size = 16 * 1024;
+
+    /**
+     * Сортирует [first, last) по 8 байтам ключей с позиции depth. Записи с равными байтами,
+     * ключи которых продолжаются дальше, досортировываются по следующим 8 байтам -
+     * так длинные общие префиксы сравниваются тоже числами, а не посимвольно.
+     */
+    template <typename T, typename KeyOf>
+    void sort_entries(Entry* first, Entry* last, size_t depth, const std::vector<T>& records, const KeyOf& key_of)
+    {
+        std::sort(first, last);
+        while (first != last)
+        {
+            auto group_end = first + 1;
+            while (group_end != last && group_end->prefix == first->prefix && group_end->rest == first->rest)
+                ++group_end;
+            if (first->rest > sizeof(uint64_t) && group_end - first > 1)
+            {
+                for (auto entry = first; entry != group_end; ++entry)
+                    *entry = make_entry(key_of(records[entry->index]), entry->index, depth + sizeof(uint64_t));
+                sort_entries(first, group_end, depth + sizeof(uint64_t), records, key_of);
+            }
+            first = group_end;
+        }
+    }
+}
+
+// Сортирует записи по ключу key_of(record). pool == nullptr - сортировка в вызывающем потоке
+template <typename T, typename KeyOf>
+void sort_by_string_key(std::vector<T>& records, KeyOf key_of, ThreadPool* pool = nullptr)
+{
+    using key_sort::Entry;
+    if (records.size() < 2)
+        return;
+
+    //раскладка по первому байту (старшему байту префикса)
+    std::vector<Entry> entries(records.size());
+    size_t bucket_begin[257] = {};
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        entries[i] = key_sort::make_entry(key_of(records[i]), static_cast<uint32_t>(i), 0);
+        ++bucket_begin[(entries[i].prefix >> 56) + 1];
+    }
+    for (size_t b = 0; b < 256; ++b)
+        bucket_begin[b + 1] += bucket_begin[b];
+
+    std::vector<Entry> buckets(entries.size());
+    size_t next[256];
+    std::copy(bucket_begin, bucket_begin + 256, next);
+    for (const auto& entry : entries)
+        buckets[next[entry.prefix >> 56]++] = entry;
+
+    //сортировка корзин
+    auto sort_bucket = [&buckets, &bucket_begin, &records, &key_of](size_t b)
+    {
+        key_sort::sort_entries(buckets.data() + bucket_begin[b], buckets.data() + bucket_begin[b + 1], 0, records, key_of);
+    };
+    if (pool != nullptr && records.size() >= 2 * key_sort::parallel_bucket_size)
+    {
+        ThreadPool::TaskGroup tasks(*pool);
+        for (size_t b = 0; b < 256; ++b)
+        {
+            if (bucket_begin[b + 1] - bucket_begin[b] >= key_sort::parallel_bucket_size)
+                tasks.run([&sort_bucket, b] { sort_bucket(b); });
+            else
+                sort_bucket(b);
+        }
+        tasks.wait();
+    }
+    else
+    {
+        for (size_t b = 0; b < 256; ++b)
+            sort_bucket(b);
+    }
+
+    //перестановка записей
+    std::vector<T> sorted;
+    sorted.reserve(records.size());
+    for (const auto& entry : buckets)
+        sorted.push_back(std::move(records[entry.index]));
+    records.swap(sorted);
+}
+
+// Сортировка записей-пар по первому элементу: строковые ключи - по префиксу, остальные - std::sort
+template <typename T, typename Less>
+void sort_records(std::vector<T>& records, Less less, ThreadPool* pool = nullptr)
+{
+    using KeyType = typename T::first_type;
+    if constexpr (std::is_convertible_v<const KeyType&, std::string_view>)
+    {
+        //номер записи хранится в 32 битах
+        if (records.size() <= UINT32_MAX)
+        {
+            sort_by_string_key(records, [](const T& record) -> const KeyType& { return record.first; }, pool);
+            return;
+        }
+    }
+    std::sort(records.begin(), records.end(), less);
+}
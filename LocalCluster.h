@@ -0,0 +1,340 @@
+#pragma once
+/**
+ * Локальный кластер: процесс-координатор и рабочие процессы на одной машине.
+ *
+ * Рабочие создаются через fork и получают копию состояния координатора на момент запуска
+ * (функции задачи, отображённые входные файлы, границы блоков и разделов), поэтому между процессами
+ * передаются только короткие сообщения: координатор отправляет описание задачи,
+ * рабочий выполняет её и отвечает результатом. Обмен идёт через пары Unix-сокетов (socketpair),
+ * сообщение - длина (4 байта) и байты.
+ *
+ * Задачи раздаются освободившимся рабочим по мере выполнения, поэтому медленная задача не задерживает остальных.
+ * У каждого рабочего своё адресное пространство: память задач не складывается в одном процессе,
+ * а падение задачи не разрушает координатор: вместо упавшего рабочего запускается новый,
+ * и задача может быть выполнена повторно.
+ *
+ * fork копирует только вызвавший поток, поэтому в момент fork (при создании кластера и при замене рабочего)
+ * другие потоки процесса не должны держать блокировок, которые понадобятся рабочему, в том числе блокировку malloc.
+ * Кластер вызывает before_fork перед каждым fork (MapReduce дожидается в нём простоя пула потоков)
+ * и останавливает движок ввода-вывода (IoEngine::shutdown), чтобы рабочий создал свой, а не унаследовал
+ * копию без потоков.
+ */
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "AsyncIO.h"
+
+namespace cluster
+{
+    // Ответы рабочего: результат задачи или текст исключения
+    constexpr char reply_ok = 'R';
+    constexpr char reply_error = 'E';
+
+    inline bool write_all(int fd, const char* data, size_t size)
+    {
+        while (size != 0)
+        {
+            auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    inline bool read_all(int fd, char* data, size_t size)
+    {
+        while (size != 0)
+        {
+            auto n = ::recv(fd, data, size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    inline bool send_message(int fd, const std::string& message)
+    {
+        auto size = static_cast<uint32_t>(message.size());
+        return write_all(fd, reinterpret_cast<const char*>(&size), sizeof(size)) && write_all(fd, message.data(), message.size());
+    }
+
+    // false - собеседник закрыл сокет или завершился
+    inline bool receive_message(int fd, std::string& message)
+    {
+        uint32_t size;
+        if (!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size)))
+            return false;
+        message.resize(size);
+        return read_all(fd, message.data(), size);
+    }
+}
+
+class LocalCluster
+{
+public:
+    // Выполняет запрос в рабочем процессе и возвращает ответ
+    using Handler = std::function<std::string(const std::string& request)>;
+    // Ответ на запрос с номером request от рабочего worker. false - остальные запросы больше не нужны
+    using ReplyHandler = std::function<bool(size_t request, size_t worker, const std::string& reply)>;
+
+    // before_fork вызывается в потоке координатора перед каждым fork и должен остановить остальные потоки процесса
+    LocalCluster(size_t workers_count, Handler _handler, std::function<void()> _before_fork = {})
+        : handler(std::move(_handler)), before_fork(std::move(_before_fork)), sockets(workers_count, -1), pids(workers_count, -1)
+    {
+        try
+        {
+            for (size_t i = 0; i < workers_count; ++i)
+                start_worker(i);
+        }
+        catch (...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    ~LocalCluster()
+    {
+        stop();
+    }
+
+    LocalCluster(const LocalCluster&) = delete;
+    LocalCluster& operator=(const LocalCluster&) = delete;
+
+    size_t size() const
+    {
+        return sockets.size();
+    }
+
+    /**
+     * Выполняет запросы на рабочих: каждый свободный рабочий получает следующий запрос.
+     * on_reply вызывается в вызывающем потоке. Запрос, который завершился исключением или во время которого
+     * рабочий умер, ставится в конец очереди, пока не наберёт max_attempts неудачных попыток; умерший рабочий
+     * заменяется новым. После последней неудачной попытки новые запросы не раздаются,
+     * выполняющиеся дожидаются и выбрасывается std::runtime_error.
+     * Если on_reply вернул false, новые запросы тоже не раздаются, но run просто завершается после выполняющихся.
+     */
+    void run(const std::vector<std::string>& requests, const ReplyHandler& on_reply, size_t max_attempts = 1)
+    {
+        std::vector<size_t> assigned(sockets.size(), no_request);
+        std::vector<size_t> failures(requests.size(), 0);
+        std::deque<size_t> queue;
+        for (size_t i = 0; i < requests.size(); ++i)
+            queue.push_back(i);
+        size_t running = 0;
+        bool stopping = false;
+        std::string error;
+        std::string reply;
+        auto failed = [&](size_t request, std::string message)
+        {
+            if (++failures[request] < max_attempts)
+                queue.push_back(request);
+            else if (error.empty())
+                error = std::move(message);
+        };
+        while (true)
+        {
+            for (size_t worker = 0; worker < sockets.size() && !queue.empty() && error.empty() && !stopping; ++worker)
+            {
+                if (assigned[worker] != no_request)
+                    continue;
+                if (sockets[worker] < 0)
+                    start_worker(worker);
+                auto request = queue.front();
+                queue.pop_front();
+                if (!cluster::send_message(sockets[worker], requests[request]))
+                {
+                    failed(request, worker_failed(worker));
+                    continue;
+                }
+                assigned[worker] = request;
+                ++running;
+            }
+            if (running == 0 && (queue.empty() || !error.empty() || stopping))
+                break;
+            if (running == 0)
+                continue;
+
+            std::vector<pollfd> fds;
+            for (size_t worker = 0; worker < sockets.size(); ++worker)
+            {
+                if (assigned[worker] != no_request)
+                    fds.push_back({ sockets[worker], POLLIN, 0 });
+            }
+            if (::poll(fds.data(), fds.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "poll");
+            }
+
+            for (size_t worker = 0; worker < sockets.size(); ++worker)
+            {
+                if (assigned[worker] == no_request || !ready(fds, sockets[worker]))
+                    continue;
+                auto request = std::exchange(assigned[worker], no_request);
+                --running;
+                if (!cluster::receive_message(sockets[worker], reply) || reply.empty())
+                {
+                    failed(request, worker_failed(worker));
+                    continue;
+                }
+                if (reply[0] == cluster::reply_error)
+                {
+                    failed(request, "worker " + std::to_string(worker) + ": " + reply.substr(1));
+                    continue;
+                }
+                if (error.empty() && !on_reply(request, worker, reply.substr(1)))
+                    stopping = true;
+            }
+        }
+        if (!error.empty())
+            throw std::runtime_error(error);
+    }
+
+private:
+    static constexpr size_t no_request = static_cast<size_t>(-1);
+
+    static bool ready(const std::vector<pollfd>& fds, int fd)
+    {
+        for (const auto& entry : fds)
+        {
+            if (entry.fd == fd)
+                return (entry.revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+        }
+        return false;
+    }
+
+    // Запускает рабочего с номером worker, в том числе вместо умершего
+    void start_worker(size_t worker)
+    {
+        if (before_fork)
+            before_fork();
+        IoEngine::shutdown();
+
+        int pair[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) != 0)
+            throw std::system_error(errno, std::generic_category(), "socketpair");
+
+        auto pid = ::fork();
+        if (pid < 0)
+        {
+            auto err = errno;
+            ::close(pair[0]);
+            ::close(pair[1]);
+            throw std::system_error(err, std::generic_category(), "fork");
+        }
+        if (pid == 0)
+        {
+            //сокеты координатора с остальными рабочими не нужны, иначе они не заметят его завершения
+            for (auto fd : sockets)
+            {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+            ::close(pair[0]);
+            worker_loop(pair[1], handler);
+        }
+
+        ::close(pair[1]);
+        sockets[worker] = pair[0];
+        pids[worker] = pid;
+    }
+
+    // Цикл рабочего процесса. Завершается, когда координатор закрывает сокет.
+    // Выход через _exit: деструкторы статических объектов координатора в копии процесса выполнять нельзя
+    [[noreturn]] static void worker_loop(int fd, const Handler& handler)
+    {
+        std::string request;
+        while (cluster::receive_message(fd, request))
+        {
+            std::string reply(1, cluster::reply_ok);
+            try
+            {
+                reply += handler(request);
+            }
+            catch (const std::exception& e)
+            {
+                reply.assign(1, cluster::reply_error);
+                reply += e.what();
+            }
+            catch (...)
+            {
+                reply.assign(1, cluster::reply_error);
+                reply += "unknown exception";
+            }
+            if (!cluster::send_message(fd, reply))
+                break;
+        }
+        ::_exit(0);
+    }
+
+    std::string worker_failed(size_t worker)
+    {
+        ::close(sockets[worker]);
+        sockets[worker] = -1;
+        int status = 0;
+        std::string reason = "exited";
+        if (::waitpid(pids[worker], &status, 0) == pids[worker])
+        {
+            if (WIFSIGNALED(status))
+                reason = "killed by signal " + std::to_string(WTERMSIG(status));
+            else if (WIFEXITED(status))
+                reason = "exited with status " + std::to_string(WEXITSTATUS(status));
+        }
+        pids[worker] = -1;
+        return "worker " + std::to_string(worker) + " " + reason;
+    }
+
+    void stop()
+    {
+        for (auto& fd : sockets)
+        {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+        for (auto& pid : pids)
+        {
+            if (pid > 0)
+            {
+                while (::waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+                {
+                }
+            }
+            pid = -1;
+        }
+    }
+
+    Handler handler;
+    std::function<void()> before_fork;
+    std::vector<int> sockets;
+    std::vector<pid_t> pids;
+};
+
+#endif
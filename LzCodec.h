@@ -0,0 +1,158 @@
+#pragma once
+/**
+ * Простой встроенный LZ77-кодек в духе LZ4 для блоков промежуточных файлов.
+ *
+ * Сжатые данные - последовательность команд:
+ *   токен (старшие 4 бита - число литералов, младшие - длина совпадения минус 4),
+ *   дополнительные байты длины литералов, литералы,
+ *   смещение совпадения (2 байта), дополнительные байты длины совпадения.
+ * Значение 15 в половине токена означает, что длина продолжается байтами (255, 255, ..., остаток).
+ * Последняя команда содержит только литералы.
+ *
+ * Смещение не превышает 65535, поэтому блоки удобно делать не больше 64 КБ,
+ * хотя кодек корректно работает и с блоками большего размера.
+ */
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+class LzCodec
+{
+public:
+    // Дописывает сжатое представление [src, src + size) в конец dst
+    void compress(const char* src, size_t size, std::string& dst)
+    {
+        if (hash_table.empty())
+            hash_table.resize(hash_table_size);
+        std::fill(hash_table.begin(), hash_table.end(), 0);
+
+        size_t anchor = 0;
+        size_t pos = 0;
+        while (size >= min_match && pos + min_match <= size)
+        {
+            auto h = hash(read32(src + pos));
+            //в таблице хранится позиция + 1, ноль - пустая ячейка
+            size_t candidate = hash_table[h];
+            hash_table[h] = static_cast<uint32_t>(pos + 1);
+
+            if (candidate == 0 || pos - (candidate - 1) > max_offset || read32(src + candidate - 1) != read32(src + pos))
+            {
+                ++pos;
+                continue;
+            }
+            --candidate;
+
+            size_t match_len = min_match;
+            while (pos + match_len < size && src[candidate + match_len] == src[pos + match_len])
+                ++match_len;
+
+            emit_sequence(src + anchor, pos - anchor, pos - candidate, match_len, dst);
+            pos += match_len;
+            anchor = pos;
+        }
+        emit_sequence(src + anchor, size - anchor, 0, 0, dst);
+    }
+
+    // Распаковывает [src, src + size) в dst, ожидаемый размер результата - raw_size.
+    // Возвращает false, если данные повреждены.
+    static bool decompress(const char* src, size_t size, std::string& dst, size_t raw_size)
+    {
+        dst.resize(raw_size);
+        auto out = dst.data();
+        size_t ip = 0;
+        size_t op = 0;
+        while (ip < size)
+        {
+            auto token = static_cast<uint8_t>(src[ip++]);
+
+            size_t literals = token >> 4;
+            if (literals == 15 && !read_length(src, size, ip, literals))
+                return false;
+            if (literals > size - ip || literals > raw_size - op)
+                return false;
+            std::memcpy(out + op, src + ip, literals);
+            ip += literals;
+            op += literals;
+
+            //последняя команда - только литералы
+            if (ip == size)
+                break;
+
+            if (size - ip < 2)
+                return false;
+            size_t offset = static_cast<uint8_t>(src[ip]) | (static_cast<size_t>(static_cast<uint8_t>(src[ip + 1])) << 8);
+            ip += 2;
+
+            size_t match_len = token & 15;
+            if (match_len == 15 && !read_length(src, size, ip, match_len))
+                return false;
+            match_len += min_match;
+
+            if (offset == 0 || offset > op || match_len > raw_size - op)
+                return false;
+            //источник и приёмник могут перекрываться (повторяющиеся последовательности), копируем побайтно
+            for (size_t i = 0; i < match_len; ++i, ++op)
+                out[op] = out[op - offset];
+        }
+        return op == raw_size;
+    }
+
+private:
+    static constexpr size_t min_match = 4;
+    static constexpr size_t max_offset = 65535;
+    static constexpr size_t hash_bits = 14;
+    static constexpr size_t hash_table_size = size_t(1) << hash_bits;
+
+    static uint32_t read32(const char* p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static size_t hash(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - hash_bits);
+    }
+
+    static void write_length(size_t length, std::string& dst)
+    {
+        for (; length >= 255; length -= 255)
+            dst.push_back(static_cast<char>(255));
+        dst.push_back(static_cast<char>(length));
+    }
+
+    static bool read_length(const char* src, size_t size, size_t& ip, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip == size)
+                return false;
+            byte = static_cast<uint8_t>(src[ip++]);
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    static void emit_sequence(const char* literals, size_t literals_count, size_t offset, size_t match_len, std::string& dst)
+    {
+        auto literals_token = std::min<size_t>(literals_count, 15);
+        auto match_token = match_len != 0 ? std::min<size_t>(match_len - min_match, 15) : 0;
+        dst.push_back(static_cast<char>((literals_token << 4) | match_token));
+        if (literals_token == 15)
+            write_length(literals_count - 15, dst);
+        dst.append(literals, literals_count);
+
+        if (match_len == 0)
+            return;
+        dst.push_back(static_cast<char>(offset & 0xff));
+        dst.push_back(static_cast<char>(offset >> 8));
+        if (match_token == 15)
+            write_length(match_len - min_match - 15, dst);
+    }
+
+    std::vector<uint32_t> hash_table;
+};
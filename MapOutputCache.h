@@ -0,0 +1,173 @@
+#pragma once
+/**
+ * Кэш выходов мапперов для инкрементального перезапуска задачи.
+ *
+ * Выход маппера зависит только от содержимого его блока и настроек задачи, поэтому блок, который не изменился
+ * с прошлого запуска, можно не читать, не отображать и не сортировать заново - достаточно взять его
+ * отсортированные файлы разделов из кэша. Ключ кэша - отпечаток (fingerprint): 128-битный хеш
+ * содержимого блока вместе с описанием настроек задачи (см. Fingerprint).
+ *
+ * Запись кэша - файлы разделов <отпечаток>_<раздел> и пустой файл-метка <отпечаток>, который создаётся последним:
+ * запись без метки (например, после падения процесса) считается отсутствующей.
+ * Все файлы появляются атомарно (через временное имя и rename) и потом не изменяются,
+ * поэтому в рабочий каталог задачи они попадают жёсткими ссылками без копирования.
+ */
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "SpillFile.h"
+
+/**
+ * Потоковый 128-битный хеш: два независимых 64-битных состояния, данные перемешиваются словами по 8 байт.
+ * Не криптографический, но случайное совпадение отпечатков двух разных блоков практически невозможно.
+ */
+class Fingerprint
+{
+public:
+    void add(std::string_view data)
+    {
+        size_t pos = 0;
+        for (; pos + 8 <= data.size(); pos += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, data.data() + pos, 8);
+            mix(word);
+        }
+        uint64_t tail = 0;
+        if (pos < data.size())
+            std::memcpy(&tail, data.data() + pos, data.size() - pos);
+        //длина отделяет части друг от друга: "ab" + "c" и "a" + "bc" дают разные отпечатки
+        mix(tail ^ (static_cast<uint64_t>(data.size()) << 3));
+    }
+
+    void add(uint64_t value)
+    {
+        mix(value);
+    }
+
+    std::string hex() const
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string result;
+        for (auto state : { finish(first), finish(second) })
+        {
+            for (int shift = 60; shift >= 0; shift -= 4)
+                result.push_back(digits[(state >> shift) & 0xF]);
+        }
+        return result;
+    }
+
+private:
+    void mix(uint64_t word)
+    {
+        first = (first ^ word) * 0x9E3779B97F4A7C15ull;
+        first ^= first >> 29;
+        second = (second + word) * 0xC2B2AE3D27D4EB4Full;
+        second ^= second >> 31;
+    }
+
+    static uint64_t finish(uint64_t state)
+    {
+        state ^= state >> 33;
+        state *= 0xFF51AFD7ED558CCDull;
+        state ^= state >> 33;
+        return state;
+    }
+
+    uint64_t first = 0x243F6A8885A308D3ull;
+    uint64_t second = 0x13198A2E03707344ull;
+};
+
+class MapOutputCache
+{
+public:
+    explicit MapOutputCache(const std::filesystem::path& _dir)
+        : dir(_dir)
+    {
+        std::filesystem::create_directories(dir);
+    }
+
+    const std::filesystem::path& path() const
+    {
+        return dir;
+    }
+
+    bool contains(const std::string& fingerprint) const
+    {
+        return std::filesystem::exists(dir / fingerprint);
+    }
+
+    // Кладёт файл раздела в рабочий каталог под именем target (без копирования, если каталоги на одном диске)
+    void fetch(const std::string& fingerprint, size_t partition, const std::string& target) const
+    {
+        link_or_copy(entry_file(fingerprint, partition), target);
+    }
+
+    /**
+     * Сохраняет файлы разделов блока. source - имя файла раздела в рабочем каталоге.
+     * Файлы, которые лежат в памяти (store), записываются на диск.
+     */
+    template <typename SourceName>
+    void store(const std::string& fingerprint, size_t partitions_count, SourceName source, const ShuffleStore* memory) const
+    {
+        for (size_t partition = 0; partition < partitions_count; ++partition)
+        {
+            auto fname = source(partition);
+            auto target = entry_file(fingerprint, partition);
+            auto temporary = spill::temporary_name(target);
+            auto segment = memory != nullptr ? memory->find(fname) : nullptr;
+            if (segment)
+            {
+                std::ofstream out(temporary, std::ios::binary);
+                out.write(segment->data(), static_cast<std::streamsize>(segment->size()));
+                out.close();
+                if (!out)
+                    throw std::system_error(errno, std::generic_category(), temporary);
+            }
+            else
+                link_or_copy(fname, temporary);
+            std::filesystem::rename(temporary, target);
+        }
+        auto mark = (dir / fingerprint).string();
+        auto temporary = spill::temporary_name(mark);
+        std::ofstream(temporary).close();
+        std::filesystem::rename(temporary, mark);
+    }
+
+    // Удаляет записи, которых нет в used, и остатки незавершённых записей
+    void prune(const std::set<std::string>& used) const
+    {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error))
+        {
+            auto name = entry.path().filename().string();
+            auto fingerprint = name.substr(0, name.find_first_of("_."));
+            if (used.count(fingerprint) == 0)
+                std::filesystem::remove(entry.path(), error);
+        }
+    }
+
+private:
+    std::string entry_file(const std::string& fingerprint, size_t partition) const
+    {
+        return (dir / (fingerprint + "_" + std::to_string(partition))).string();
+    }
+
+    static void link_or_copy(const std::string& from, const std::string& to)
+    {
+        std::error_code error;
+        std::filesystem::remove(to, error);
+        std::filesystem::create_hard_link(from, to, error);
+        if (error)
+            std::filesystem::copy_file(from, to);
+    }
+
+    std::filesystem::path dir;
+};
@@ -18,361 +18,1638 @@
  */
 #include <vector>
 #include <filesystem>
-#include <fstream> 
+#include <optional>
 #include <functional>
-#include <thread>
+#include <map>
+#include <memory>
+#include <set>
+#include <typeinfo>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <cstdint>
+
+#include <iterator>
 
 #include "ExternalMergeSort.h"
+#include "MappedFile.h"
+#include "InputFiles.h"
+#include "ThreadPool.h"
+#include "SpillFile.h"
+#include "Stats.h"
+#include "RangePartitioner.h"
+#include "Arena.h"
+#include "KeySort.h"
+#include "ShuffleStore.h"
+#include "LocalCluster.h"
+#include "TaskAttempts.h"
+#include "ScratchDirectory.h"
+#include "MapOutputCache.h"
 #include <numeric>
-#include <sstream>
 #include <algorithm>
 
+/**
+ * Key и Value - типы ключа и значения, которые выдаёт маппер и получает редьюсер.
+ * Input - тип аргумента маппера, получается из строки входного файла через InputParser<Input>.
+ * Ключи и значения записываются в промежуточные файлы через Serializer<Key> и Serializer<Value>,
+ * ключи должны быть сравнимы оператором < и иметь std::hash (для разбиения по разделам по умолчанию).
+ * OutKey и OutValue - типы записей, которые выдаёт редьюсер. В файл результата они пишутся строками
+ * "ключ<TAB>значение" через TextFormatter.
+ */
+template <typename Key = std::string, typename Value = std::string, typename Input = std::string_view,
+          typename OutKey = Key, typename OutValue = Value>
 class MapReduce
 {
 public:
+    using Record = std::pair<Key, Value>;
+    using OutRecord = std::pair<OutKey, OutValue>;
+
+    /**
+     * Значения одного ключа, которые получает редьюсер.
+     * Это однопроходный диапазон: значения читаются из раздела по мере перебора,
+     * поэтому в памяти одновременно находится только одна запись, каким бы большим ни был раздел.
+     * Непросмотренные редьюсером значения пропускаются автоматически.
+     */
+    class Values;
+
+private:
+    // Записи маппера до записи на диск: строки хранятся в арене задачи (см. Arena.h)
+    using StoredKey = typename ArenaStorage<Key>::type;
+    using StoredValue = typename ArenaStorage<Value>::type;
+    using MapRecord = std::pair<StoredKey, StoredValue>;
+
+    // Раздел редьюсера читается слиянием файлов всех мапперов на лету
+    using PartitionReader = MergedReader<Record, typename SpillIO<Key, Value>::Reader, KeyLess<Key, Value>>;
+
+public:
+    class Values
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using value_type = Value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Value*;
+            using reference = const Value&;
+
+            iterator() = default;
+
+            reference operator*() const
+            {
+                return values->current.second;
+            }
+
+            pointer operator->() const
+            {
+                return &values->current.second;
+            }
+
+            iterator& operator++()
+            {
+                values->advance();
+                if (values->exhausted)
+                    values = nullptr;
+                return *this;
+            }
+
+            bool operator==(const iterator& rhs) const
+            {
+                return values == rhs.values;
+            }
+
+            bool operator!=(const iterator& rhs) const
+            {
+                return values != rhs.values;
+            }
+
+        private:
+            friend class Values;
+
+            explicit iterator(Values* _values)
+                : values(_values)
+            {
+
+            }
+
+            Values* values = nullptr;
+        };
+
+        iterator begin()
+        {
+            return exhausted ? iterator() : iterator(this);
+        }
+
+        iterator end()
+        {
+            return iterator();
+        }
+
+    private:
+        friend class MapReduce;
+
+        Values(PartitionReader& _reader, Record& _current, bool& _has_current, const Key& _key, uint64_t& _records_read)
+            : reader(_reader), current(_current), has_current(_has_current), key(_key), records_read(_records_read)
+        {
+
+        }
+
+        void advance()
+        {
+            //раздел отсортирован, поэтому группа заканчивается на первом большем ключе
+            has_current = reader.read(current);
+            if (has_current)
+                ++records_read;
+            exhausted = !has_current || key < current.first;
+        }
+
+        void skip_rest()
+        {
+            while (!exhausted)
+                advance();
+        }
+
+        PartitionReader& reader;
+        Record& current;
+        bool& has_current;
+        const Key& key;
+        uint64_t& records_read;
+        bool exhausted = false;
+    };
+
+    /**
+     * Приёмник записей редьюсера: для одного ключа редьюсер может выдать любое число записей, в том числе ни одной.
+     * Записи сразу уходят в выходной файл раздела через буфер записи и в памяти не накапливаются.
+     */
+    class Output
+    {
+    public:
+        void emit(const OutKey& key, const OutValue& value)
+        {
+            ++records_count;
+            if (records)
+            {
+                records->write(key, value);
+                return;
+            }
+            line.clear();
+            TextFormatter<OutKey>::write(line, key);
+            line.push_back('\t');
+            TextFormatter<OutValue>::write(line, value);
+            line.push_back('\n');
+            text->write(line.data(), line.size());
+        }
+
+    private:
+        friend class MapReduce;
+
+        Output() = default;
+
+        void close()
+        {
+            if (records)
+                records->close();
+            else
+                text->close();
+        }
 
-    MapReduce(size_t _mappers_count, size_t _reducers_count)
-        : mappers_count(_mappers_count), reducers_count(_reducers_count)
+        // текстовый выход раздела или (для слияния по ключам) двоичный в формате SpillFile.h
+        std::optional<SegmentWriter> text;
+        std::optional<typename SpillIO<OutKey, OutValue>::Writer> records;
+        std::string line;
+        uint64_t records_count = 0;
+    };
+
+    // Получает ключ и все его значения, результат выдаёт через Output
+    using Reducer = std::function<void(const Key&, Values&, Output&)>;
+
+    /**
+     * Где хранятся промежуточные данные: файлы разделов мапперов, прогоны, промежуточные слияния
+     * и результаты редьюсеров.
+     * disk - файлы в рабочем каталоге задачи (см. set_scratch_directory).
+     * memory - в памяти процесса (см. ShuffleStore.h), пока их суммарный объём не больше spill_threshold байт;
+     * не поместившиеся файлы пишутся на диск. Небольшие задачи тогда не создают ни одного файла, кроме output.
+     */
+    enum class Shuffle
     {
+        disk,
+        memory
+    };
+
+    static constexpr size_t default_spill_threshold = 1024 * 1024 * 1024;
 
+    /**
+     * Потоки создаются один раз и живут, пока жив объект: повторные вызовы run их переиспользуют.
+     * Пул состоит из max(_mappers_count, _reducers_count) потоков, но не больше числа аппаратных потоков.
+     * Работа каждой фазы делится на задачи мельче, чем поток (см. set_tasks_per_thread):
+     * _mappers_count * tasks_per_thread блоков на фазе map и _reducers_count * tasks_per_thread разделов на фазе reduce,
+     * поэтому медленный блок или раздел не задерживает остальные потоки.
+     */
+    MapReduce(size_t _mappers_count, size_t _reducers_count, Shuffle shuffle = Shuffle::disk, size_t spill_threshold = default_spill_threshold)
+        : MapReduce(_mappers_count, _reducers_count,
+                    std::make_shared<ThreadPool>(std::min(std::max(_mappers_count, _reducers_count), ThreadPool::hardware_threads())),
+                    shuffle == Shuffle::memory ? std::make_shared<ShuffleStore>(spill_threshold) : nullptr)
+    {
+
+    }
+
+    /**
+     * Задача с общими ресурсами: несколько задач в одном процессе могут выполняться одновременно (каждая из своего потока),
+     * деля пул _pool - общий бюджет потоков, а значит и памяти прогонов (не больше memory_budget на поток) -
+     * и хранилище _store - общий бюджет памяти shuffle (_store == nullptr - Shuffle::disk).
+     * _mappers_count и _reducers_count задают только число задач фаз (см. set_tasks_per_thread).
+     * Промежуточные файлы задач не пересекаются: у каждой свой рабочий каталог.
+     */
+    MapReduce(size_t _mappers_count, size_t _reducers_count, std::shared_ptr<ThreadPool> _pool, std::shared_ptr<ShuffleStore> _store = nullptr)
+        : mappers_count(_mappers_count), reducers_count(_reducers_count), shuffle_store(std::move(_store)), pool(std::move(_pool))
+    {
+        spill_io.store = shuffle_store.get();
     }
 
-    void set_mapper(std::function<std::pair<std::string, std::string>(std::string)> _mapper)
+    // Рабочий каталог удаляется вместе с объектом, сегменты в общем хранилище - тоже
+    ~MapReduce()
     {
-        mapper = _mapper;
+        if (shuffle_store && scratch)
+            shuffle_store->remove_prefix(scratch->file(""));
     }
 
-    void set_reducer(std::function<bool(std::string, std::pair<std::string, std::string>)> _reducer)
+    /**
+     * Маппер - любой вызываемый объект, который принимает Input и возвращает пару (ключ, значение).
+     * Ключ и значение могут быть любых типов, из которых конструируются Key и Value:
+     * если вместо std::string вернуть std::string_view на строку входа, в куче не выделяется ничего -
+     * строки копируются в арену задачи маппера (см. Arena.h).
+     * Маппер не оборачивается в std::function: цикл по строкам блока инстанцируется для его типа,
+     * так что тип стирается один раз на блок, а не на каждую запись.
+     */
+    template <typename F>
+    void set_mapper(F _mapper)
+    {
+        block_mapper = [_mapper](const MapReduce& self, const std::vector<InputFile>& input, const Block& block, const TaskAttempt& attempt)
+        {
+            self.mapper_do_work(_mapper, input, block, attempt);
+        };
+        sample_mapper = [_mapper](std::string_view line)
+        {
+            return Key(_mapper(InputParser<Input>::parse(line)).first);
+        };
+    }
+
+    void set_reducer(Reducer _reducer)
     {
         reducer = _reducer;
     }
 
-    void run(const std::filesystem::path& input, const std::filesystem::path& output)
+    /**
+     * Необязательная свёртка значений с одинаковым ключом (combiner).
+     * Выполняется над отсортированным выходом каждого маппера перед записью и ещё раз при слиянии разделов,
+     * поэтому дальше по конвейеру идёт одна запись на ключ вместо всех повторов.
+     * Функция должна быть ассоциативной: редьюсер получит уже свёрнутые значения.
+     */
+    using Combiner = std::function<Value(const Value&, const Value&)>;
+
+    void set_combiner(Combiner _combiner)
     {
-        auto blocks = split_input_file(input, mappers_count);
+        combiner = _combiner;
+    }
+
+    /**
+     * Функция, определяющая номер раздела (редьюсера) для ключа.
+     * Должна возвращать одинаковый номер для одинаковых ключей и значение меньше partitions_count.
+     * По умолчанию используется хеш ключа.
+     */
+    using Partitioner = std::function<size_t(const Key& key, size_t partitions_count)>;
 
-        // Создаём mappers_count потоков
-        // В каждом потоке читаем свой блок данных
+    void set_partitioner(Partitioner _partitioner)
+    {
+        partitioner = _partitioner;
+        custom_partitioner = true;
+    }
+
+    /**
+     * Разбиение по диапазонам ключей вместо partitioner (см. RangePartitioner.h).
+     * Перед фазой map каждый блок параллельно выбирает samples_per_partition * разделов / блоков
+     * равномерно расположенных строк и применяет к ним маппер, по квантилям полученных ключей строятся границы разделов.
+     * Разделы получаются равными по числу записей и упорядоченными: ключи раздела i меньше ключей раздела i + 1.
+     *
+     * split_heavy_keys - записи ключа, занимающего больше одного раздела, раскладываются по его разделам по кругу.
+     * Тогда редьюсер вызывается для такого ключа несколько раз с частями значений,
+     * поэтому включать можно только для редьюсеров, результат которых собирается из результатов по частям.
+     */
+    void set_range_partitioning(bool enabled, size_t _samples_per_partition = 100, bool _split_heavy_keys = false)
+    {
+        range_partitioning = enabled;
+        samples_per_partition = std::max<size_t>(_samples_per_partition, 1);
+        split_heavy_keys = _split_heavy_keys;
+    }
+
+    /**
+     * Сколько задач приходится на один поток в каждой фазе (по умолчанию 4).
+     * Чем больше задач, тем равномернее нагрузка на потоки при перекосе данных,
+     * но тем больше промежуточных файлов (блоков * разделов).
+     */
+    void set_tasks_per_thread(size_t count)
+    {
+        tasks_per_thread = std::max<size_t>(count, 1);
+    }
+
+    /**
+     * Наименьший размер блока входа в байтах (по умолчанию 1 МБ). Маленький вход делится не на
+     * mappers * tasks_per_thread блоков, а на столько, чтобы каждый был не меньше bytes:
+     * иначе задачи map, а за ними и файлы разделов (блоков * разделов), тратят больше, чем обрабатывают.
+     */
+    void set_min_block_size(size_t bytes)
+    {
+        min_block_size = std::max<size_t>(bytes, 1);
+    }
+
+    /**
+     * Конвейерное выполнение: редьюсеры начинают сливать файлы разделов по мере завершения мапперов,
+     * а не после барьера в конце фазы map. merge_factor - сколько готовых файлов раздела сливаются
+     * в один промежуточный, пока мапперы ещё работают.
+     */
+    void set_pipelined(bool enabled, size_t _merge_factor = 8)
+    {
+        pipelined = enabled;
+        merge_factor = std::max<size_t>(_merge_factor, 2);
+    }
+
+    /**
+     * Объём памяти (в байтах), который маппер может занять под свой результат перед сортировкой.
+     * Если результат блока больше, он сортируется частями (прогонами), которые сбрасываются на диск
+     * и затем сливаются, поэтому размер блока не ограничен объёмом оперативной памяти.
+     */
+    void set_memory_budget(size_t bytes)
+    {
+        memory_budget = bytes;
+    }
+
+    /**
+     * Параллельная сортировка прогона маппера: строковые ключи сортируются по кэшированному префиксу
+     * (см. KeySort.h), и большие корзины первого байта раздаются в задачи пула.
+     * Полезно, когда блоков меньше, чем потоков, или блоки сильно различаются по размеру. По умолчанию выключено.
+     */
+    void set_parallel_sort(bool enabled)
+    {
+        parallel_sort = enabled;
+    }
+
+    /**
+     * Сжатие блоков промежуточных файлов встроенным LZ-кодеком.
+     * Уменьшает объём записи на диск ценой процессорного времени, по умолчанию выключено.
+     */
+    void set_spill_compression(bool enabled)
+    {
+        spill_io.compress = enabled;
+    }
+
+    /**
+     * Как run собирает файл output из выходов редьюсеров.
+     * concat - выходы разделов склеиваются по порядку номеров, все разделы копируются параллельно.
+     *          При разбиении диапазонами (set_range_partitioning) результат упорядочен по ключам.
+     * sorted - выходы разделов сливаются по ключам результата (k-way merge), поэтому результат упорядочен
+     *          при любом разбиении. Редьюсер должен выдавать записи раздела по возрастанию OutKey.
+     * none   - output - каталог, редьюсер раздела i пишет прямо в файл output/part-i, сборки нет.
+     */
+    enum class OutputMerge
+    {
+        concat,
+        sorted,
+        none
+    };
+
+    void set_output_merge(OutputMerge merge)
+    {
+        output_merge = merge;
+    }
+
+    /**
+     * Режим локального кластера: задачи map и reduce выполняются не в потоках пула, а в workers рабочих процессах
+     * (см. LocalCluster.h), которые создаются на время запуска. Каждый рабочий выполняет одну задачу за раз
+     * в своём адресном пространстве. Разделы мапперов передаются редьюсерам через файлы рабочего каталога,
+     * поэтому Shuffle::memory, конвейерное выполнение и параллельная сортировка прогонов в этом режиме не используются.
+     * Выборка ключей, сборка результата и fold_partitions выполняются координатором. 0 - выключено.
+     * Перед каждым fork координатор ждёт простоя пула потоков, поэтому общий с другими задачами пул
+     * на это время должен быть свободен от их задач.
+     */
+    void set_local_cluster(size_t workers)
+    {
+        cluster_workers = workers;
+    }
+
+    /**
+     * Корень для рабочих каталогов (по умолчанию текущий каталог), например быстрый локальный диск.
+     * Задача создаёт в нём свой каталог (см. ScratchDirectory.h) при первом запуске, очищает его в начале
+     * каждого запуска и удаляет вместе с объектом. Старый каталог удаляется сразу.
+     */
+    void set_scratch_directory(const std::filesystem::path& root)
+    {
+        if (shuffle_store && scratch)
+            shuffle_store->remove_prefix(scratch->file(""));
+        scratch.reset();
+        scratch_root = root;
+    }
+
+    /**
+     * Инкрементальный перезапуск: выходы мапперов сохраняются в каталоге cache_dir (см. MapOutputCache.h),
+     * и следующие запуски - в том числе в другом процессе - берут оттуда результаты блоков, содержимое которых
+     * не изменилось. Мапятся только новые и изменённые данные, затем всё сливается как обычно.
+     * Чтобы дописывание в конец входных файлов не сдвигало границы блоков, вход делится не на
+     * mappers * tasks_per_thread частей, а на блоки примерно по block_size байт внутри каждого файла:
+     * после дописывания меняется только последний блок файла.
+     * version описывает маппер, combiner и partitioner (set_partitioner): если любой из них изменился, поменяйте version,
+     * иначе из кэша возьмутся старые результаты. Сам кэш различает только, задан ли combiner и свой partitioner, но не какие.
+     * В кэше остаются только блоки последнего запуска, поэтому у каждой задачи должен быть свой каталог.
+     * С разбиением по диапазонам (set_range_partitioning) кэш не используется: границы разделов зависят от всех данных.
+     * Пустой cache_dir - выключено.
+     */
+    void set_map_cache(const std::filesystem::path& cache_dir, const std::string& version = {}, size_t block_size = 64 * 1024 * 1024)
+    {
+        map_cache.reset();
+        if (!cache_dir.empty())
+            map_cache.emplace(cache_dir);
+        map_cache_version = version;
+        cache_block_size = std::max<size_t>(block_size, 1);
+    }
+
+    /**
+     * Сколько раз запускается задача map, слияния или reduce, которая завершилась исключением
+     * (в режиме локального кластера - и задача, рабочий которой упал), прежде чем запуск завершится ошибкой.
+     * Файлы задач появляются атомарно (см. SpillFile.h), поэтому повторная попытка не видит остатков неудачной.
+     * По умолчанию 3, 1 - без повторов.
+     */
+    void set_task_attempts(size_t attempts)
+    {
+        max_task_attempts = std::max<size_t>(attempts, 1);
+    }
+
+    /**
+     * Спекулятивное выполнение: задача map или reduce, которая выполняется дольше slowdown медиан
+     * уже завершённых задач своей фазы, получает запасную попытку в свободном потоке (см. TaskAttempts.h).
+     * Засчитывается попытка, которая завершилась первой, вторая прерывается.
+     * Маппер, combiner и редьюсер должны быть детерминированными. По умолчанию выключено.
+     */
+    void set_speculative_execution(bool enabled, double slowdown = 2.0)
+    {
+        speculation_slowdown = enabled ? slowdown : 0;
+    }
+
+    /**
+     * Досрочное завершение (см. CancellationToken в TaskAttempts.h). Маппер, combiner, редьюсер или fold захватывают
+     * флаг и вызывают cancel(), когда ответ уже известен; взвести его можно и из другого потока.
+     * Выполняющиеся задачи map, слияния, reduce и fold останавливаются при ближайшей проверке, новые не запускаются.
+     * run собирает результат из того, что успели записать редьюсеры, включая записи, выданные до cancel(),
+     * и отмечает в JobStats::cancelled, что результат частичный. Флаг сбрасывается в начале run, sort и fold_partitions.
+     */
+    std::shared_ptr<CancellationToken> cancellation_token() const
+    {
+        return cancellation;
+    }
+
+    /**
+     * Выполняет задачу и возвращает статистику запуска: время, записи и байты каждой задачи по фазам,
+     * объём промежуточных файлов и пиковую память (см. Stats.h).
+     * Вход - файлы, каталоги и шаблоны имён (см. InputFiles.h). Все файлы вместе делятся на блоки:
+     * мелкие файлы объединяются в один блок, крупные делятся на несколько по границам строк.
+     */
+    JobStats run(const std::vector<std::filesystem::path>& input, const std::filesystem::path& output)
+    {
+        if (output_merge == OutputMerge::none)
+            std::filesystem::create_directories(output);
+        auto reduced_file_names = execute(input, true, output);
+        //редьюсеры, которые не успели начать, выходов не оставили
+        if (cancellation->cancelled())
+            remove_missing(reduced_file_names);
+        auto task = recorder.begin("output", 0, pool->current_thread());
+        task.records_in = reduced_file_names.size();
+        task.bytes_in = files_size(reduced_file_names);
+
+        //Пишем результаты в файл output
+        if (output_merge == OutputMerge::concat)
+            concat_outputs(reduced_file_names, output);
+        else if (output_merge == OutputMerge::sorted)
+            merge_outputs(reduced_file_names, output);
+
+        if (output_merge != OutputMerge::none)
+        {
+            for (const auto& fname : reduced_file_names)
+                spill_io.remove(fname);
+            std::error_code error;
+            task.bytes_out = std::filesystem::file_size(output, error);
+        }
+        else
+            task.bytes_out = task.bytes_in;
+        recorder.end(task);
+        return finish_stats();
+    }
+
+    JobStats run(const std::filesystem::path& input, const std::filesystem::path& output)
+    {
+        return run(std::vector<std::filesystem::path>{ input }, output);
+    }
+
+    /**
+     * Итеративные задачи.
+     * sort выполняет только фазы map и shuffle: разделы остаются на диске (или в памяти) отсортированными (и свёрнутыми combiner),
+     * редьюсер не вызывается. После этого fold_partitions может сколько угодно раз пройти по ним
+     * без повторного чтения входа и сортировки. Разделы действительны до следующего вызова run или sort.
+     */
+    JobStats sort(const std::vector<std::filesystem::path>& input)
+    {
+        execute(input, false);
+        return finish_stats();
+    }
+
+    JobStats sort(const std::filesystem::path& input)
+    {
+        return sort(std::vector<std::filesystem::path>{ input });
+    }
+
+    /**
+     * Параллельно сворачивает каждый раздел последнего запуска: fold(state, record) вызывается
+     * для записей раздела по возрастанию ключей. Возвращает состояния разделов в порядке их номеров.
+     * Если partitioner сохраняет порядок ключей (ключи раздела i меньше ключей раздела i + 1),
+     * результаты вместе образуют один проход по всем ключам в отсортированном порядке.
+     */
+    template <typename State, typename Fold>
+    std::vector<State> fold_partitions(Fold fold, const State& initial = State{})
+    {
+        std::vector<State> states(sorted_partitions.size(), initial);
+        cancellation->reset();
+        ThreadPool::TaskGroup tasks(*pool);
+        for (size_t i = 0; i < sorted_partitions.size(); ++i)
+        {
+            tasks.run([this, i, &fold, &states]
+            {
+                PartitionReader reader(openReaders(sorted_partitions[i], spill_io), make_merge_combiner());
+                Record record;
+                while (!cancellation->cancelled() && reader.read(record))
+                    fold(states[i], static_cast<const Record&>(record));
+            });
+        }
+        tasks.wait();
+        return states;
+    }
+
+private:
+    // Часть блока внутри одного входного файла: [from, to)
+    struct BlockPiece
+    {
+        size_t file;
+        size_t from;
+        size_t to;
+    };
+
+    struct Block
+    {
+        std::vector<BlockPiece> pieces;
+
+        size_t num;
+    };
+
+    struct InputFile
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type write_time;
+        std::uintmax_t size = 0;
+        std::unique_ptr<MappedFile> file;
+    };
+
+    // Входные файлы последнего запуска вместе с границами блоков.
+    // Повторные запуски не отображают заново неизменённые файлы, а если не изменился ни один - не ищут границы блоков.
+    struct InputCache
+    {
+        std::vector<InputFile> files;
+        std::vector<Block> blocks;
+        // размер блоков разбиения с кэшем выходов мапперов, 0 - вход делится на blocks_count частей
+        size_t block_size = 0;
+    };
+
+    const std::vector<InputFile>& open_input(const std::vector<std::filesystem::path>& input, std::vector<Block>& blocks)
+    {
+        auto task = recorder.begin("split", 0, pool->current_thread());
+        auto paths = expand_input_paths(input);
+
+        std::map<std::filesystem::path, size_t> cached;
+        for (size_t i = 0; i < input_cache.files.size(); ++i)
+            cached.emplace(input_cache.files[i].path, i);
+
+        std::vector<InputFile> files(paths.size());
+        bool changed = files.size() != input_cache.files.size();
+        uint64_t total_size = 0;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            auto& file = files[i];
+            file.path = std::filesystem::absolute(paths[i]);
+            file.write_time = std::filesystem::last_write_time(file.path);
+            file.size = std::filesystem::file_size(file.path);
+
+            auto it = cached.find(file.path);
+            if (it != cached.end())
+            {
+                auto& old = input_cache.files[it->second];
+                if (old.file && old.write_time == file.write_time && old.size == file.size)
+                    file.file = std::move(old.file);
+                changed = changed || it->second != i;
+            }
+            if (!file.file)
+            {
+                file.file = std::make_unique<MappedFile>(file.path);
+                changed = true;
+            }
+            total_size += file.size;
+        }
+        input_cache.files = std::move(files);
+        auto block_size = map_cache ? cache_block_size : 0;
+        //маленький вход не делится на блоки меньше min_block_size
+        auto count = static_cast<size_t>(std::clamp<uint64_t>(total_size / min_block_size, 1, blocks_count));
+        if (changed || input_cache.block_size != block_size || (block_size == 0 && input_cache.blocks.size() != count))
+        {
+            input_cache.blocks = block_size != 0 ? split_input_files_by_size(input_cache.files, block_size)
+                                                 : split_input_files(input_cache.files, count);
+            input_cache.block_size = block_size;
+        }
+
+        blocks = input_cache.blocks;
+        task.bytes_in = total_size;
+        task.records_in = input_cache.files.size();
+        task.records_out = blocks.size();
+        recorder.end(task);
+        return input_cache.files;
+    }
+
+    // Выполняет map и shuffle, а если reduce - то и редьюсеры. Возвращает имена выходов редьюсеров
+    std::vector<std::string> execute(const std::vector<std::filesystem::path>& input, bool reduce, const std::filesystem::path& output = {})
+    {
+        recorder.start();
+        cancellation->reset();
+        blocks_count = mappers_count * tasks_per_thread;
+        partitions_count = reducers_count * tasks_per_thread;
+        //данные предыдущего запуска больше не нужны
+        if (!scratch)
+            scratch.emplace(scratch_root);
+        else
+            scratch->clear();
+        if (shuffle_store)
+            shuffle_store->remove_prefix(scratch->file(""));
+        std::vector<Block> blocks;
+        //Входные файлы отображаются в память один раз, мапперы читают свои блоки прямо из отображения
+        const auto& input_files = open_input(input, blocks);
+        blocks_count = blocks.size();
+        if (range_partitioning)
+            build_ranges(input_files, blocks);
+        fetch_cached_blocks(input_files, blocks);
+
+        // Создаём blocks_count задач в пуле потоков
+        // В каждой задаче читаем свой блок данных
         // Применяем к строкам данных функцию mapper
-        // Сортируем результат каждого потока
+        // Сортируем результат каждой задачи
         // Результат сохраняется в файловую систему (представляем, что это большие данные)
-        // Каждый поток сохраняет результат в свой файл (представляем, что потоки выполняются на разных узлах)
+        // Каждая задача сохраняет результат в свои файлы (представляем, что задачи выполняются на разных узлах)
+
+        std::vector<std::string> reduced_file_names;
+        reduced_file_names.reserve(partitions_count);
+        for (size_t i = 0; i < partitions_count; ++i)
+            reduced_file_names.emplace_back(output_merge == OutputMerge::none ? (output / ("part-" + std::to_string(i))).string()
+                                                                              : scratch->file("reduce_" + std::to_string(i) + "_output"));
+
+        sorted_partitions.assign(partitions_count, {});
+        reduce_enabled = reduce;
+        if (cluster_workers != 0)
+            run_cluster(input_files, blocks, reduced_file_names);
+        else if (pipelined)
+            run_pipelined(input_files, blocks, reduced_file_names);
+        else
+            run_phases(input_files, blocks, reduced_file_names);
+        if (!block_fingerprints.empty())
+            map_cache->prune(std::set<std::string>(block_fingerprints.begin(), block_fingerprints.end()));
+        return reduced_file_names;
+    }
+
+    JobStats finish_stats()
+    {
+        auto stats = recorder.finish();
+        stats.cancelled = cancellation->cancelled();
+        return stats;
+    }
 
-        std::vector<std::thread> mapper_thread_pool;
-        for(size_t i=0; i < mappers_count; ++i)
+    /**
+     * Отпечатки блоков для кэша выходов мапперов. Блоки, которые есть в кэше, сразу кладутся в рабочий каталог
+     * как выходы мапперов и не мапятся. В отпечаток входят и настройки, от которых зависят файлы разделов.
+     */
+    void fetch_cached_blocks(const std::vector<InputFile>& input_files, const std::vector<Block>& blocks)
+    {
+        block_fingerprints.clear();
+        cached_blocks.assign(blocks_count, false);
+        if (!map_cache || range_partitioning)
+            return;
+
+        Fingerprint job;
+        job.add(map_cache_version);
+        for (auto type : { typeid(Key).name(), typeid(Value).name(), typeid(Input).name() })
+            job.add(std::string_view(type));
+        job.add(partitions_count);
+        //какие именно partitioner и combiner заданы, описывает version
+        job.add(custom_partitioner ? 1 : 0);
+        job.add(combiner ? 1 : 0);
+
+        block_fingerprints.resize(blocks_count);
+        ThreadPool::TaskGroup tasks(*pool);
+        for (const auto& block : blocks)
         {
-            auto mapper_thread = std::thread(&MapReduce::mapper_do_work, this, std::ref(input), std::ref(blocks[i]));
-            mapper_thread_pool.emplace_back(std::move(mapper_thread));
+            tasks.run([this, &input_files, &block, job]() mutable
+            {
+                auto task = recorder.begin("fingerprint", block.num, pool->current_thread());
+                for (const auto& piece : block.pieces)
+                {
+                    task.bytes_in += piece.to - piece.from;
+                    job.add(input_files[piece.file].file->view(piece.from, piece.to));
+                }
+                auto& fingerprint = block_fingerprints[block.num];
+                fingerprint = job.hex();
+                if (map_cache->contains(fingerprint))
+                {
+                    for (size_t partition = 0; partition < partitions_count; ++partition)
+                        map_cache->fetch(fingerprint, partition, mapped_file_name(block.num, partition));
+                    cached_blocks[block.num] = true;
+                    task.bytes_out = files_size(mapped_file_names(block.num));
+                }
+                task.records_out = cached_blocks[block.num] ? 1 : 0;
+                recorder.end(task);
+            });
         }
-        join_threads(mapper_thread_pool);
+        tasks.wait();
+    }
+
+    // Сохраняет в кэш выходы маппера блока, который был замаплен в этом запуске
+    void cache_block(size_t block_num) const
+    {
+        if (block_fingerprints.empty() || cached_blocks[block_num])
+            return;
+        map_cache->store(block_fingerprints[block_num], partitions_count,
+                         [this, block_num](size_t partition) { return mapped_file_name(block_num, partition); }, spill_io.store);
+    }
+
+    // Выборка ключей для границ разделов: маппер применяется к равномерно расположенным строкам каждого блока
+    void build_ranges(const std::vector<InputFile>& input_files, const std::vector<Block>& blocks)
+    {
+        auto samples_per_block = (samples_per_partition * partitions_count + blocks_count - 1) / blocks_count;
+        std::vector<std::vector<Key>> samples(blocks.size());
 
-        //Выполняем многопутевое слияние получившихся отсортированных файлов на этапе Map.
-        //На выходе получаем один отсортированный файл. Разбиваем его на reduce_count файлов для фазы reduce. 
-        //В каком-то смысле это узкое место, т.к. такой файл нужно где-то хранить. 
-        //С другой стороны, в дальнейшей обработке он не участвует, т.к. разбивается на более мелкие файлы.
-        //К тому же его длина равна длине исходного файла, который тоже где-то нужно хранить, поэтому такое допущение считаю оправданным (храним условно там же)
+        ThreadPool::TaskGroup sample_tasks(*pool);
+        for (const auto& block : blocks)
+        {
+            sample_tasks.run([this, &input_files, &block, &samples, samples_per_block]
+            {
+                auto task = recorder.begin("sample", block.num, pool->current_thread());
+                auto& keys = samples[block.num];
+                uint64_t block_size = 0;
+                for (const auto& piece : block.pieces)
+                    block_size += piece.to - piece.from;
 
-        auto merge_sorted_fname = "merge_sorted";
-        mergeFiles<std::string>(merge_sorted_fname, "mapped", mappers_count);
+                //каждая часть блока получает долю выборки по своему размеру
+                for (const auto& piece : block.pieces)
+                {
+                    const auto& input_file = *input_files[piece.file].file;
+                    auto size = piece.to - piece.from;
+                    auto piece_samples = (samples_per_block * size + block_size - 1) / block_size;
+                    size_t next_line = piece.from;
+                    for (size_t i = 0; i < piece_samples && size != 0; ++i)
+                    {
+                        //строка, начинающаяся не раньше очередной точки выборки
+                        auto pos = std::max(next_line, piece.from + size * i / piece_samples);
+                        if (pos != piece.from && pos != next_line)
+                            pos = input_file.find_line_end(pos) + 1;
+                        if (pos >= piece.to)
+                            break;
+                        auto line_end = std::min(input_file.find_line_end(pos), piece.to);
+                        next_line = line_end + 1;
+                        if (line_end == pos)
+                            continue;
+                        keys.push_back(sample_mapper(input_file.view(pos, line_end)));
+                    }
+                }
+                task.bytes_in = block_size;
+                task.records_out = keys.size();
+                recorder.end(task);
+            });
+        }
+        sample_tasks.wait();
 
-        //Cоздаем reduce_count новых файлов
-        //Читаем результат фазы map и перекладываем в reducers_count (вход фазы reduce)
-        // Перекладываем так, чтобы:
-        //     * данные были отсортированы
-        //     * одинаковые ключи оказывались в одном файле, чтобы одинаковые ключи попали на один редьюсер
-        //     * файлы примерно одинакового размера, чтобы редьюсеры были загружены примерно равномерно
-        // Для упрощения задачи делаем это в один поток
-        // Но все данные в память одновременно не загружаем, читаем построчно и пишем
+        std::vector<Key> all_samples;
+        for (auto& keys : samples)
+            std::move(keys.begin(), keys.end(), std::back_inserter(all_samples));
+        ranges.build(std::move(all_samples), partitions_count, split_heavy_keys);
+    }
 
-        size_t total_lines_count = 0;
+    // Раздел полностью собран из файлов segments: запоминаем их для fold_partitions и запускаем редьюсер
+    void partition_ready(size_t partition, std::vector<std::string> segments, const std::string& reduced_file_name, PhaseAttempts& reduce_attempts)
+    {
+        sorted_partitions[partition] = std::move(segments);
+        if (reduce_enabled)
+        {
+            reduce_attempts.run([this, partition, &reduced_file_name](const TaskAttempt& attempt)
+            {
+                reducer_do_work(partition, sorted_partitions[partition], reduced_file_name, attempt);
+            });
+        }
+    }
+
+    // Ожидание задач фазы: пока они выполняются, отстающим запускаются запасные попытки
+    void wait_phase(ThreadPool::TaskGroup& tasks, std::initializer_list<PhaseAttempts*> phases) const
+    {
+        tasks.wait([&phases]
+        {
+            for (auto phase : phases)
+                phase->speculate();
+        }, speculation_period);
+    }
+
+    // Фазы map и reduce разделены барьером: редьюсеры стартуют после завершения всех мапперов
+    void run_phases(const std::vector<InputFile>& input_files, std::vector<Block>& blocks, const std::vector<std::string>& reduced_file_names)
+    {
+        ThreadPool::TaskGroup map_tasks(*pool);
+        PhaseAttempts map_attempts(map_tasks, max_task_attempts, speculation_slowdown, cancellation.get());
         for (const auto& block : blocks)
-            total_lines_count += block.lines_count;
+        {
+            if (cached_blocks[block.num])
+                continue;
+            map_attempts.run([this, &input_files, &block](const TaskAttempt& attempt)
+            {
+                block_mapper(*this, input_files, block, attempt);
+            },
+            [this, &block] { cache_block(block.num); });
+        }
+        wait_phase(map_tasks, { &map_attempts });
 
-        auto reduced_file_names = create_reduced_files(merge_sorted_fname, total_lines_count);
+        //Перемешивание (shuffle) выполняется без единого слияния всех файлов:
+        //каждый маппер уже разложил свой отсортированный результат на partitions_count разделов (mapped_<блок>_<раздел>)
+        //с помощью partitioner, так что одинаковые ключи всегда попадают в раздел с одним и тем же номером.
+        //Каждый редьюсер сам выполняет многопутевое слияние только своих blocks_count файлов,
+        //поэтому слияния разных разделов идут параллельно, а общий файл merge_sorted больше не нужен.
 
-        // Создаём reducers_count потоков
-        // В каждом потоке читаем свой файл (выход предыдущей фазы)
+        // Создаём partitions_count задач в пуле потоков
+        // В каждой задаче сливаем свой раздел из выходов всех мапперов (выход предыдущей фазы)
         // Применяем к строкам функцию reducer
         // Результат сохраняется в файловую систему 
         // (во многих задачах выход редьюсера - большие данные, хотя в нашей задаче можно написать функцию reduce так, чтобы выход не был большим)
 
-        std::vector<std::thread> reducer_thread_pool;
-        for (size_t i = 0; i < reducers_count; ++i)
+        ThreadPool::TaskGroup reduce_tasks(*pool);
+        PhaseAttempts reduce_attempts(reduce_tasks, max_task_attempts, speculation_slowdown, cancellation.get());
+        for (size_t i = 0; i < partitions_count; ++i)
         {
-            auto reducer_thread = std::thread(&MapReduce::reducer_do_work, this, std::ref(reduced_file_names[i]));
-            reducer_thread_pool.emplace_back(std::move(reducer_thread));
+            auto partition_files = partition_file_names(i);
+            //после досрочного завершения часть мапперов не записала свои файлы, а отсутствующий файл - ошибка чтения
+            if (cancellation->cancelled())
+                remove_missing(partition_files);
+            partition_ready(i, std::move(partition_files), reduced_file_names[i], reduce_attempts);
         }
-        join_threads(reducer_thread_pool);
-
+        wait_phase(reduce_tasks, { &reduce_attempts });
+    }
 
-        //Пишем результаты в файл output
-        std::ofstream results(output);
-        int cnt = 0;
-        for (const auto& file : reduced_file_names)
+    /**
+     * Фазы map и reduce выполняются рабочими процессами локального кластера с барьером между ними, как run_phases.
+     * Рабочие - копии координатора, поэтому запрос задачи - только её фаза и номер.
+     * Ответ - статистика задачи, которая добавляется к статистике запуска.
+     */
+    void run_cluster(const std::vector<InputFile>& input_files, std::vector<Block>& blocks, const std::vector<std::string>& reduced_file_names)
+    {
+#ifdef _WIN32
+        throw std::runtime_error("local cluster mode is not supported on Windows");
+#else
+        //в рабочих нет потоков пула, а память процесса другим процессам не видна
+        auto store = std::exchange(spill_io.store, nullptr);
+        auto parallel = std::exchange(parallel_sort, false);
+        try
         {
-            auto m_file = std::ifstream(file + "_output");
-            std::string line;
-            std::getline(m_file, line);
-            results << line;
-            if (cnt!= reduced_file_names.size()-1)
-                results << std::endl;
-            ++cnt;
+            //fork копирует только поток координатора: перед каждым fork потоки пула должны простаивать без блокировок
+            auto wait_pool = [this] { pool->wait_idle(); };
+            LocalCluster cluster(cluster_workers, [this, &input_files, &blocks, &reduced_file_names](const std::string& request)
+            {
+                //статистика, скопированная из координатора при fork, не относится к задачам рабочего
+                recorder.take_tasks();
+                auto index = std::stoul(request.substr(1));
+                TaskAttempt attempt(nullptr, 0, cancellation.get());
+                try
+                {
+                    if (request[0] == 'm')
+                        block_mapper(*this, input_files, blocks.at(index), attempt);
+                    else
+                        reducer_do_work(index, partition_file_names(index), reduced_file_names.at(index), attempt);
+                }
+                catch (const AttemptCancelled&)
+                {
+                }
+
+                //флаг досрочного завершения рабочего передаётся координатору первым байтом ответа
+                std::string reply(1, cancellation->cancelled() ? '1' : '0');
+                for (const auto& task : recorder.take_tasks())
+                    task.write(reply);
+                return reply;
+            }, wait_pool);
 
-            m_file.close();
+            auto add_stats = [this](size_t, size_t worker, const std::string& reply)
+            {
+                if (!reply.empty() && reply[0] == '1')
+                    cancellation->cancel();
+                std::string_view tasks(reply);
+                tasks.remove_prefix(std::min<size_t>(tasks.size(), 1));
+                TaskStats task;
+                while (task.read(tasks))
+                {
+                    //рабочие на временной шкале - отдельные потоки после потоков пула и координатора
+                    task.thread = pool->size() + 1 + worker;
+                    recorder.add(std::move(task));
+                }
+                return !cancellation->cancelled();
+            };
+            auto requests = [](char phase, size_t count, const std::vector<char>& skip)
+            {
+                std::vector<std::string> result;
+                result.reserve(count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (i >= skip.size() || !skip[i])
+                        result.push_back(phase + std::to_string(i));
+                }
+                return result;
+            };
+
+            cluster.run(requests('m', blocks_count, cached_blocks), add_stats, max_task_attempts);
+            //после досрочного завершения часть мапперов не дописала свои файлы
+            if (!cancellation->cancelled())
+            {
+                for (size_t i = 0; i < blocks_count; ++i)
+                    cache_block(i);
+                for (size_t i = 0; i < partitions_count; ++i)
+                    sorted_partitions[i] = partition_file_names(i);
+                if (reduce_enabled)
+                    cluster.run(requests('r', partitions_count, {}), add_stats, max_task_attempts);
+            }
+        }
+        catch (...)
+        {
+            spill_io.store = store;
+            parallel_sort = parallel;
+            throw;
         }
-        results.close();
+        spill_io.store = store;
+        parallel_sort = parallel;
+#endif
     }
 
-private:
-    struct Block
+    // Состояние раздела при конвейерном выполнении
+    struct PartitionShuffle
     {
-        size_t from;
-        size_t to;
-
-        size_t num;
-        size_t lines_count;
+        std::mutex mutex;
+        // готовые отсортированные файлы раздела: выходы мапперов и результаты промежуточных слияний
+        std::vector<std::string> segments;
+        // сколько мапперов уже отдали свой файл раздела
+        size_t arrived = 0;
+        // сколько промежуточных слияний запущено (для имён файлов)
+        size_t merges = 0;
+        bool merging = false;
     };
-    std::vector<Block> split_input_file(const std::filesystem::path& path, size_t blocks_count) const
+
+    /**
+     * Фазы map и reduce перекрываются (как ранний shuffle в Hadoop).
+     * Как только маппер закончил, его файлы разделов передаются разделам.
+     * Когда у раздела накопилось merge_factor готовых файлов, они сразу сливаются в один в отдельной задаче,
+     * пока остальные мапперы ещё работают. Редьюсер раздела запускается, как только пришёл последний файл раздела
+     * и промежуточное слияние (если было) закончилось, не дожидаясь остальных разделов.
+     * Все задачи - map, слияния и reduce - выполняются в одной группе без барьеров между фазами.
+     */
+    void run_pipelined(const std::vector<InputFile>& input_files, std::vector<Block>& blocks, const std::vector<std::string>& reduced_file_names)
+    {
+        std::vector<PartitionShuffle> shuffle(partitions_count);
+        //засчитанные попытки вызывают segment_ready из потоков пула, поэтому он объявлен раньше группы задач:
+        //если запуск прерван исключением, группа дожидается своих задач до того, как он будет разрушен
+        std::function<void(size_t, std::string, bool)> segment_ready;
+        ThreadPool::TaskGroup tasks(*pool);
+        //фазы объявлены в обратном порядке: фаза, которая запускает задачи следующей, разрушается раньше неё.
+        //Входы промежуточного слияния удаляются, как только оно засчитано, поэтому запасных попыток у слияний нет
+        PhaseAttempts reduce_attempts(tasks, max_task_attempts, speculation_slowdown, cancellation.get());
+        PhaseAttempts merge_attempts(tasks, max_task_attempts, 0, cancellation.get());
+        PhaseAttempts map_attempts(tasks, max_task_attempts, speculation_slowdown, cancellation.get());
+
+        segment_ready = [&](size_t partition, std::string segment, bool from_mapper)
+        {
+            auto& state = shuffle[partition];
+            std::vector<std::string> segments;
+            bool merge = false;
+            std::string merged_fname;
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.segments.push_back(std::move(segment));
+                if (from_mapper)
+                    ++state.arrived;
+                else
+                    state.merging = false;
+
+                if (state.merging)
+                    return;
+
+                if (state.arrived < blocks_count && state.segments.size() >= merge_factor)
+                {
+                    //пока мапперы ещё работают, сливаем накопившиеся файлы раздела в один
+                    merge = true;
+                    state.merging = true;
+                    merged_fname = merged_file_name(partition, state.merges++);
+                    segments.swap(state.segments);
+                }
+                else if (state.arrived == blocks_count)
+                {
+                    //все мапперы отдали раздел и слияний больше нет - можно запускать редьюсер
+                    segments.swap(state.segments);
+                }
+                else
+                    return;
+            }
+
+            if (merge)
+            {
+                auto inputs = std::make_shared<std::vector<std::string>>(std::move(segments));
+                merge_attempts.run([this, partition, inputs, merged_fname](const TaskAttempt& attempt)
+                {
+                    auto task = recorder.begin("merge", partition, pool->current_thread());
+                    task.bytes_in = files_size(*inputs);
+                    auto counts = merge_spill_files(merged_fname, *inputs, attempt);
+                    task.records_in = counts.elements_in;
+                    task.records_out = counts.elements_out;
+                    task.bytes_out = task.spill_bytes = files_size({ merged_fname });
+                    recorder.end(task);
+                },
+                [this, &segment_ready, partition, inputs, merged_fname]
+                {
+                    //входы удаляются только после успешного слияния: повторная попытка читает их заново
+                    for (const auto& fname : *inputs)
+                        spill_io.remove(fname);
+                    segment_ready(partition, merged_fname, false);
+                });
+            }
+            else
+                partition_ready(partition, std::move(segments), reduced_file_names[partition], reduce_attempts);
+        };
+
+        for (const auto& block : blocks)
+        {
+            if (cached_blocks[block.num])
+            {
+                //выходы маппера уже взяты из кэша
+                for (size_t partition = 0; partition < partitions_count; ++partition)
+                    segment_ready(partition, mapped_file_name(block.num, partition), true);
+                continue;
+            }
+            map_attempts.run([this, &input_files, &block](const TaskAttempt& attempt)
+            {
+                block_mapper(*this, input_files, block, attempt);
+            },
+            [this, &block, &segment_ready]
+            {
+                //сохраняем до того, как слияния раздела удалят файлы маппера
+                cache_block(block.num);
+                for (size_t partition = 0; partition < partitions_count; ++partition)
+                    segment_ready(partition, mapped_file_name(block.num, partition), true);
+            });
+        }
+        wait_phase(tasks, { &map_attempts, &reduce_attempts });
+    }
+
+    std::vector<Block> split_input_files(const std::vector<InputFile>& files, size_t blocks_count) const
     {
         /**
-         * Эта функция не читает весь файл.
+         * Эта функция не читает файлы целиком.
          *
-         * Определяем размер файла в байтах.
-         * Делим размер на количество блоков - получаем границы блоков.
+         * Файлы рассматриваются как один файл - их склейка по порядку.
+         * Делим суммарный размер на количество блоков - получаем границы блоков.
          * Читаем данные только вблизи границ.
-         * Выравниваем границы блоков по границам строк.
+         * Выравниваем границы блоков по границам строк: граница сдвигается вперёд до ближайшего перевода строки.
+         * Конец каждого файла - тоже граница строки, поэтому строка никогда не склеивается из двух файлов.
+         *
+         * Блок - это набор частей [from, to) файлов подряд, to указывает на перевод строки или конец файла.
+         * Мелкие файлы целиком попадают в один блок, крупный файл делится между несколькими блоками.
          */
         std::vector<Block> blocks;
-        auto fsize = std::filesystem::file_size(path);
-        auto block_bounds = fsize / blocks_count;
-        auto elapsed_bytes = fsize - block_bounds * blocks_count;
-        std::ifstream file(path);
+        blocks.reserve(blocks_count);
+        uint64_t total_size = 0;
+        for (const auto& file : files)
+            total_size += file.size;
 
-        uintmax_t pos1 = 0;
-        auto pos2 = block_bounds + elapsed_bytes;
+        size_t file = 0;
+        size_t from = 0;
+        // смещение начала текущего файла в склейке
+        uint64_t file_start = 0;
         for (size_t i = 0; i < blocks_count; ++i)
         {
             Block block;
-            file.seekg(pos2);
-            char ch = ' ';
-            int elapsed = 0;
-            while (file.get(ch) && ch != '\n')
-            {
-                --pos2;
-                ++elapsed;
-                file.seekg(pos2);
+            block.num = i;
+            auto last_block = i + 1 == blocks_count;
+            auto bound = total_size / blocks_count * (i + 1);
+            while (file < files.size())
+            {
+                auto fsize = files[file].size;
+                if (last_block || file_start + fsize <= bound)
+                {
+                    //остаток файла целиком до границы блока
+                    if (from < fsize)
+                        block.pieces.push_back({ file, from, fsize });
+                    file_start += fsize;
+                    ++file;
+                    from = 0;
+                    if (!last_block && file_start == bound)
+                        break;
+                    continue;
+                }
+
+                auto bound_pos = bound > file_start ? static_cast<size_t>(bound - file_start) : 0;
+                auto to = files[file].file->find_line_end(std::max(from, bound_pos));
+                if (from < to)
+                    block.pieces.push_back({ file, from, to });
+                from = to + 1;
+                if (from >= fsize)
+                {
+                    file_start += fsize;
+                    ++file;
+                    from = 0;
+                }
+                break;
             }
-            block.from = pos1;
-            block.to = pos2;
-            pos1 = pos2 + 1;
-            pos2 = pos1 + block_bounds + elapsed;
+            blocks.push_back(std::move(block));
+        }
+        return blocks;
+    }
 
-            block.num = i;
-            blocks.push_back(block);
+    /**
+     * Разбиение для кэша выходов мапперов: каждый файл делится на блоки примерно по block_size байт по границам строк.
+     * Граница блока зависит только от данных перед ней, поэтому дописывание в конец файла меняет только его последний блок.
+     */
+    std::vector<Block> split_input_files_by_size(const std::vector<InputFile>& files, size_t block_size) const
+    {
+        std::vector<Block> blocks;
+        for (size_t file = 0; file < files.size(); ++file)
+        {
+            auto fsize = files[file].size;
+            size_t from = 0;
+            while (from < fsize)
+            {
+                auto to = fsize - from > block_size ? files[file].file->find_line_end(from + block_size) : fsize;
+                Block block;
+                block.num = blocks.size();
+                block.pieces.push_back({ file, from, to });
+                blocks.push_back(std::move(block));
+                from = to + 1;
+            }
         }
-        file.close();
+        //пустой вход - один пустой блок, чтобы у разделов были файлы
+        if (blocks.empty())
+            blocks.push_back(Block{ {}, 0 });
         return blocks;
     }
 
-    void mapper_do_work(const std::filesystem::path& input, Block& block) const
+    template <typename F>
+    void mapper_do_work(const F& map, const std::vector<InputFile>& input, const Block& block, const TaskAttempt& attempt) const
     {   
-        //Read input file
-        std::vector<std::string> data;
-        read_input_file(input, block, data);
-        //Map
-        std::vector<std::pair<std::string, std::string>> map_output;
-        std::transform(data.begin(), data.end(), std::back_inserter(map_output), mapper);
+        auto task = recorder.begin("map", block.num, pool->current_thread());
+        auto piece_view = [&input, &block, &task](size_t piece)
+        {
+            const auto& part = block.pieces[piece];
+            task.bytes_in += part.to - part.from;
+            return input[part.file].file->view(part.from, part.to);
+        };
+        //Read input file line by line and map
+        //Строки не копируются: они ссылаются на отображённые в память файлы,
+        //а ключи и значения маппера хранятся в арене, которая освобождается после записи каждого прогона
+        size_t piece = 0;
+        LineReader lines(block.pieces.empty() ? std::string_view() : piece_view(piece));
+        Arena arena;
+        uint64_t lines_count = 0;
+        auto read = [&map, &lines, &piece, &piece_view, &block, &arena, &lines_count, &attempt](MapRecord& record)
+        {
+            std::string_view line;
+            while (!lines.next(line))
+            {
+                if (++piece >= block.pieces.size())
+                    return false;
+                lines = LineReader(piece_view(piece));
+            }
+            //задача уже выполнена запасной попыткой
+            attempt.check();
+            ++lines_count;
+            auto result = map(InputParser<Input>::parse(line));
+            record.first = ArenaStorage<Key>::store(std::move(result.first), arena);
+            record.second = ArenaStorage<Value>::store(std::move(result.second), arena);
+            return true;
+        };
+
         //Sort
-        std::sort(map_output.begin(), map_output.end());
-        //Write to output mapped file
-        write_to_mapped_file(block, map_output);
-    }
+        //Результат маппера сортируется прогонами не больше memory_budget байт.
+        //Если весь блок поместился в один прогон, он сразу пишется в выходные файлы маппера,
+        //иначе прогоны сохраняются во временные файлы и затем сливаются по разделам.
+        //Прогоны разных попыток одной задачи называются по-разному, чтобы запасная попытка не удалила прогоны основной.
+        bool single_run = false;
+        size_t runs_written = 0;
+        auto write_run = [this, &block, &attempt, &single_run, &runs_written, &task, &arena](std::vector<MapRecord>& run, size_t run_number, MapRecord* next)
+        {
+            //Combine
+            combine_sorted(run, arena);
+            task.records_out += run.size();
+            //Write to output mapped file
+            single_run = run_number == 0 && next == nullptr;
+            runs_written = run_number + 1;
+            write_to_mapped_file(block, run, single_run ? std::string() : run_suffix(attempt, run_number), attempt);
+            //первая запись следующего прогона уже прочитана в арену - переносим её в освобождённую
+            std::optional<Record> first;
+            if (next != nullptr)
+                first.emplace(ArenaStorage<Key>::load(next->first), ArenaStorage<Value>::load(next->second));
+            arena.release();
+            if (first)
+            {
+                next->first = ArenaStorage<Key>::store(std::move(first->first), arena);
+                next->second = ArenaStorage<Value>::store(std::move(first->second), arena);
+            }
+        };
+        auto sort_run = [this](std::vector<MapRecord>& run, KeyLess<StoredKey, StoredValue> less)
+        {
+            sort_records(run, less, parallel_sort ? pool.get() : nullptr);
+        };
+        TaskStats merge_task;
+        try
+        {
+            auto runs_count = createInitialRuns<MapRecord>(read, memory_budget, write_run, KeyLess<StoredKey, StoredValue>{}, sort_run);
+            task.records_in = lines_count;
+            if (single_run)
+            {
+                task.bytes_out = task.spill_bytes = files_size(mapped_file_names(block.num));
+                recorder.end(task);
+                return;
+            }
 
-    void reducer_do_work(const std::string& fname) const
-    {
-        //Read reduced file
-        std::vector<std::pair<std::string, std::string>> data;
-        read_reduced_file(fname, data);
-        //Reduce
-        std::vector<bool> reduce_output;
+            //Merge runs of every partition
+            merge_task = recorder.begin("map merge", block.num, pool->current_thread());
+            for (size_t partition = 0; partition < partitions_count; ++partition)
+            {
+                attempt.check();
+                auto fname = mapped_file_name(block.num, partition);
+                std::vector<std::string> run_files;
+                run_files.reserve(runs_count);
+                for (size_t i = 0; i < runs_count; ++i)
+                    run_files.emplace_back(fname + run_suffix(attempt, i));
+
+                merge_task.bytes_in += files_size(run_files);
+                auto counts = merge_spill_files(fname, run_files, attempt);
+                merge_task.records_in += counts.elements_in;
+                merge_task.records_out += counts.elements_out;
 
-        std::string previous_data;
-        for (const auto& el : data)
+                for (const auto& run_file : run_files)
+                    spill_io.remove(run_file);
+            }
+        }
+        catch (...)
         {
-            reduce_output.emplace_back(reducer(previous_data, el));
-            previous_data = el.first;
+            //неудачная или прерванная попытка не оставляет своих прогонов
+            for (size_t partition = 0; partition < partitions_count; ++partition)
+            {
+                for (size_t i = 0; i < runs_written; ++i)
+                    remove_quietly(mapped_file_name(block.num, partition) + run_suffix(attempt, i));
+            }
+            throw;
         }
-        //Write to output file
-        write_to_output_file(fname, reduce_output);
+        merge_task.bytes_out = merge_task.spill_bytes = files_size(mapped_file_names(block.num));
+        recorder.end(merge_task);
+
+        //прогоны записаны на диск и прочитаны при слиянии ещё раз
+        task.bytes_out = merge_task.bytes_out;
+        task.spill_bytes = merge_task.bytes_in;
+        recorder.end(task);
     }
 
-    void join_threads(std::vector<std::thread>& thread_pool) const
+    // Слияние выходов мапперов; прерывается, когда результат попытки больше не нужен, и публикуется атомарно с этой проверкой
+    MergeCounts merge_spill_files(const std::string& output_file, const std::vector<std::string>& input_files, const TaskAttempt& attempt) const
     {
-        for (size_t i = 0; i < thread_pool.size(); ++i)
-        {
-            if (thread_pool[i].joinable())
-                thread_pool[i].join();
-        }
+        return mergeFiles<Record, SpillIO<Key, Value>, KeyLess<Key, Value>>(output_file, input_files, make_merge_combiner(), spill_io,
+                                                                     [&attempt] { attempt.check(); },
+                                                                     [&attempt](const std::function<void()>& close) { attempt.publish(close); });
     }
 
-    void read_input_file(const std::filesystem::path& input, Block& block, std::vector<std::string>& data) const
+    void reducer_do_work(size_t partition, const std::vector<std::string>& partition_files, const std::string& fname, const TaskAttempt& attempt) const
     {
-        std::ifstream input_file(input);
+        auto task = recorder.begin("reduce", partition, pool->current_thread());
+        task.bytes_in = files_size(partition_files);
+        //Merge partition files on the fly, without writing the merged partition
+        PartitionReader reduced_file(openReaders(partition_files, spill_io), make_merge_combiner());
+        //Reduce: read merged partition group by group
+        Record current;
+        auto has_current = reduced_file.read(current);
+        uint64_t records_read = has_current ? 1 : 0;
 
-        char ch;
-        std::string str;
-        input_file.seekg(block.from);
+        //Write to output file: записи редьюсера пишутся по мере выдачи
+        Output output;
+        if (output_merge == OutputMerge::sorted)
+            output.records.emplace(fname, spill_io.compress, spill_io.store);
+        else
+            output.text.emplace(fname, output_merge == OutputMerge::none ? nullptr : spill_io.store);
 
-        while (input_file.get(ch) && input_file.tellg()<=block.to)
+        Key key;
+        try
         {
-            if (ch != '\n')
-                str += ch;
-            else
+            while (has_current)
             {
-                if (!str.empty())
-                    data.push_back(str);
-
-                str.clear();
+                attempt.check();
+                key = current.first;
+                Values values(reduced_file, current, has_current, key, records_read);
+                reducer(key, values, output);
+                values.skip_rest();
             }
         }
-        if (!str.empty())
-            data.push_back(str);
+        catch (const AttemptCancelled&)
+        {
+            //при досрочном завершении запуска записи, выданные до cancel(), остаются в результате
+            if (attempt.superseded() || !attempt.job_cancelled())
+                throw;
+        }
+        output.close();
+        task.records_in = records_read;
+        task.records_out = output.records_count;
+        task.bytes_out = files_size({ fname });
+        recorder.end(task);
+    }
 
-        input_file.close();
+    // Склейка текстовых выходов разделов: размеры известны заранее, поэтому каждый раздел
+    // копируется в свою часть файла output отдельной задачей
+    void concat_outputs(const std::vector<std::string>& fnames, const std::filesystem::path& output)
+    {
+        std::vector<uint64_t> offsets(fnames.size() + 1, 0);
+        for (size_t i = 0; i < fnames.size(); ++i)
+            offsets[i + 1] = offsets[i] + spill_io.size(fnames[i]);
 
-        block.lines_count = data.size();
+        int fd = async_io::open_file(output.string(), true);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), output.string());
+        try
+        {
+            ThreadPool::TaskGroup tasks(*pool);
+            for (size_t i = 0; i < fnames.size(); ++i)
+                tasks.run([this, fd, &fnames, &offsets, i] { copy_output(fnames[i], fd, offsets[i]); });
+            tasks.wait();
+        }
+        catch (...)
+        {
+            async_io::close_file(fd);
+            throw;
+        }
+        async_io::close_file(fd);
     }
 
-    void write_to_mapped_file(Block& block,const std::vector<std::pair<std::string, std::string>>& map_output) const
+    void copy_output(const std::string& fname, int fd, uint64_t offset) const
     {
-        std::ofstream mapped_file("mapped_" + std::to_string(block.num));
+        auto write_at = [fd, &fname](const char* data, size_t size, uint64_t position)
+        {
+            IoRequest request;
+            request.fd = fd;
+            request.buffer = const_cast<char*>(data);
+            request.size = size;
+            request.offset = position;
+            request.write = true;
+            auto result = async_io::perform(request);
+            if (result < 0 || static_cast<size_t>(result) != size)
+                throw std::system_error(result < 0 ? static_cast<int>(-result) : EIO, std::generic_category(), fname);
+        };
 
-        size_t counter = 0;
-        auto map_size = map_output.size();
-        for (const auto& el : map_output)
+        if (shuffle_store)
         {
-            mapped_file << el.first << " " << el.second;
-            if (counter != (map_size - 1))      //если это последний элемент
-                mapped_file << std::endl;       //перенос строки не нужен
-            ++counter;
+            if (auto segment = shuffle_store->find(fname))
+            {
+                write_at(segment->data(), segment->size(), offset);
+                return;
+            }
+        }
+
+        AsyncFileReader in(fname);
+        std::unique_ptr<char[]> buffer(new char[async_io::default_chunk_size]);
+        while (auto size = in.read(buffer.get(), async_io::default_chunk_size))
+        {
+            write_at(buffer.get(), size, offset);
+            offset += size;
         }
-        mapped_file.close();
     }
 
-    std::vector<std::string> create_reduced_files(const std::string& merge_sorted_fname, size_t total_lines_count) const
+    // Слияние двоичных выходов разделов по ключам результата с записью текста в output
+    void merge_outputs(const std::vector<std::string>& fnames, const std::filesystem::path& output) const
     {
-        std::vector<std::ofstream> reduced_files;
-        reduced_files.reserve(reducers_count);
+        SpillIO<OutKey, OutValue> io;
+        io.store = spill_io.store;
+        MergedReader<OutRecord, typename SpillIO<OutKey, OutValue>::Reader, KeyLess<OutKey, OutValue>> reader(openReaders(fnames, io));
 
-        std::vector<std::string> reduced_file_names;
-        reduced_file_names.reserve(reducers_count);
-        for (size_t i = 0; i < reducers_count; ++i)
+        AsyncFileWriter out(output.string());
+        OutRecord record;
+        std::string line;
+        while (reader.read(record))
         {
-            auto f_name = "reduce_" + std::to_string(i);
-            reduced_files.emplace_back(f_name);
-            reduced_file_names.emplace_back(f_name);
+            line.clear();
+            TextFormatter<OutKey>::write(line, record.first);
+            line.push_back('\t');
+            TextFormatter<OutValue>::write(line, record.second);
+            line.push_back('\n');
+            out.write(line.data(), line.size());
         }
+        out.close();
+    }
 
-        auto file_bounds = total_lines_count / reducers_count;
-        auto elapsed_lines = total_lines_count - file_bounds * reducers_count;
-        auto lines_in_file = file_bounds + elapsed_lines;
+    MergeCombiner<Record> make_merge_combiner() const
+    {
+        if (!combiner)
+            return {};
 
-        std::ifstream merge_sorted_file(merge_sorted_fname);
-        size_t lines_added = 0;
-        auto reduced_file_pos = 0;
+        return [this](Record& accumulated, const Record& next)
+        {
+            //слияние идёт по возрастанию ключей, поэтому достаточно одного сравнения
+            if (accumulated.first < next.first)
+                return false;
+            accumulated.second = combiner(accumulated.second, next.second);
+            return true;
+        };
+    }
 
-        std::string new_line, last_line;
+    void combine_sorted(std::vector<MapRecord>& records, Arena& arena) const
+    {
+        if (!combiner || records.empty())
+            return;
 
-        while (std::getline(merge_sorted_file, new_line))
+        //Сворачиваем соседние записи с одинаковыми ключами на месте
+        size_t last = 0;
+        for (size_t i = 1; i < records.size(); ++i)
         {
-            if (last_line != new_line && lines_added == lines_in_file - 1 && reduced_file_pos != reducers_count - 1)  //осталась последняя строка для записи в старый файл, но в ней новые данные
+            if (records[last].first < records[i].first)
             {
-                //пишем в новый файл, если он есть
-                ++reduced_file_pos;
-
-                reduced_files[reduced_file_pos] << new_line;
-                lines_added = 1;
-                lines_in_file = file_bounds + 1;
+                if (++last != i)
+                    records[last] = std::move(records[i]);
             }
             else
             {
-                if (last_line == new_line && lines_added == 0)   //хотим писать в новый файл, но строка совпадает с последней строкой предыдущего
-                {
-                    //пишем в старый файл
-                    auto last_file_pos = reduced_file_pos - 1;
-                    reduced_files[last_file_pos] << std::endl << new_line;
-                    --lines_in_file;
-                }
-                else
-                {
-                    if (lines_added != 0)
-                        reduced_files[reduced_file_pos] << std::endl;
-                    reduced_files[reduced_file_pos] << new_line;
-
-                    ++lines_added;
-                    if (lines_added == lines_in_file)
-                    {
-                        ++reduced_file_pos;
-
-                        lines_added = 0;
-                        lines_in_file = file_bounds;
-                    }
-                }
+                auto combined = combiner(ArenaStorage<Value>::load(records[last].second), ArenaStorage<Value>::load(records[i].second));
+                records[last].second = ArenaStorage<Value>::store(std::move(combined), arena);
             }
-            last_line = new_line;
         }
+        records.resize(last + 1);
+    }
+
+    std::string mapped_file_name(size_t block_num, size_t partition) const
+    {
+        return scratch->file("mapped_" + std::to_string(block_num) + "_" + std::to_string(partition));
+    }
 
-        for (auto& file : reduced_files)
-            file.close();
+    // Выходы всех мапперов для раздела partition
+    std::vector<std::string> partition_file_names(size_t partition) const
+    {
+        std::vector<std::string> names;
+        names.reserve(blocks_count);
+        for (size_t block_num = 0; block_num < blocks_count; ++block_num)
+            names.emplace_back(mapped_file_name(block_num, partition));
+        return names;
+    }
 
-        return reduced_file_names;
+    std::vector<std::string> mapped_file_names(size_t block_num) const
+    {
+        std::vector<std::string> names;
+        names.reserve(partitions_count);
+        for (size_t partition = 0; partition < partitions_count; ++partition)
+            names.emplace_back(mapped_file_name(block_num, partition));
+        return names;
     }
 
-    void read_reduced_file(const std::string& reduced_fname, std::vector<std::pair<std::string, std::string>>& data) const
+    // Суммарный размер файлов (в памяти или на диске), отсутствующие файлы не учитываются
+    uint64_t files_size(const std::vector<std::string>& fnames) const
     {
-        std::string line;
+        uint64_t size = 0;
+        for (const auto& fname : fnames)
+            size += spill_io.size(fname);
+        return size;
+    }
+
+    // Убирает из списка имена файлов, которых нет ни в памяти, ни на диске
+    void remove_missing(std::vector<std::string>& fnames) const
+    {
+        fnames.erase(std::remove_if(fnames.begin(), fnames.end(), [this](const std::string& fname) { return !spill_io.exists(fname); }),
+                     fnames.end());
+    }
+
+    std::string merged_file_name(size_t partition, size_t merge_number) const
+    {
+        return scratch->file("merged_" + std::to_string(partition) + "_" + std::to_string(merge_number));
+    }
 
-        std::ifstream reduced_file(reduced_fname);
-        while (std::getline(reduced_file, line))
+    static std::string run_suffix(const TaskAttempt& attempt, size_t run_number)
+    {
+        if (attempt.attempt_number() == 0)
+            return "_run_" + std::to_string(run_number);
+        return "_a" + std::to_string(attempt.attempt_number()) + "_run_" + std::to_string(run_number);
+    }
+
+    void remove_quietly(const std::string& fname) const noexcept
+    {
+        try
+        {
+            spill_io.remove(fname);
+        }
+        catch (...)
         {
-            std::stringstream ss(line);
-            std::string first, second;
-            std::getline(ss, first, ' ');
-            std::getline(ss, second, ' ');
-            data.emplace_back(std::make_pair(first,second));
         }
-        reduced_file.close();
     }
 
-    void write_to_output_file(const std::string& fname, std::vector<bool> reduce_output) const
+    void write_to_mapped_file(const Block& block, const std::vector<MapRecord>& map_output, const std::string& suffix, const TaskAttempt& attempt) const
     {
-        std::ofstream reduced_file(fname+"_output");
+        //Каждый маппер пишет partitions_count файлов - по одному на раздел.
+        //Внутри раздела порядок сохраняется, поэтому каждый файл остаётся отсортированным.
+        std::vector<typename SpillIO<Key, Value>::Writer> mapped_files;
+        mapped_files.reserve(partitions_count);
+        for (size_t i = 0; i < partitions_count; ++i)
+            mapped_files.emplace_back(spill_io.open_writer(mapped_file_name(block.num, i) + suffix));
 
-        /*
-        Запись всех результатов в файл - скорее всего это избыточно.
-        size_t counter = 0;
-        auto reduce_size = reduce_output.size();
-        for (const auto& el : reduce_output)
+        if (range_partitioning)
         {
-            reduced_file << el;
-            if (counter != (reduce_size - 1))     //если это последний элемент
-                reduced_file << std::endl;       //перенос строки не нужен
-            ++counter;
-        }*/
-
-        /*Достаточно записать, было ли хоть раз получено false в результате работы reducerа с текущим файлом (вектор reduce_output)*/
-        if (std::find(reduce_output.begin(),reduce_output.end(),false)==reduce_output.end())
-            reduced_file << "1";
+            size_t spread = block.num;
+            for (const auto& el : map_output)
+                mapped_files[ranges(el.first, spread)].write(el);
+        }
         else
-            reduced_file << "0";
+        {
+            for (const auto& el : map_output)
+                mapped_files[partition_of(el.first)].write(el);
+        }
+
+        //файлы опоздавшей попытки могли быть уже прочитаны и удалены слиянием - незакрытые writers их отбрасывают
+        attempt.publish([&mapped_files]
+        {
+            for (auto& file : mapped_files)
+                file.close();
+        });
+    }
+
+    static size_t hash_partitioner(const Key& key, size_t partitions_count)
+    {
+        return std::hash<Key>{}(key) % partitions_count;
+    }
 
-        reduced_file.close();
+    size_t partition_of(const StoredKey& key) const
+    {
+        //для хеша по умолчанию ключ из арены не нужно превращать в Key: std::hash<std::string_view> совпадает с std::hash<std::string>
+        if (!custom_partitioner)
+            return std::hash<StoredKey>{}(key) % partitions_count;
+        if constexpr (std::is_same_v<StoredKey, Key>)
+            return partitioner(key, partitions_count);
+        else
+            return partitioner(Key(key), partitions_count);
     }
 
     size_t mappers_count;
     size_t reducers_count;
+    size_t tasks_per_thread = 4;
+    size_t min_block_size = 1024 * 1024;
+    // количество блоков (задач map) и разделов (задач reduce) текущего запуска
+    size_t blocks_count = 0;
+    size_t partitions_count = 0;
+    size_t memory_budget = 64 * 1024 * 1024;
+    bool parallel_sort = false;
+    bool pipelined = false;
+    size_t merge_factor = 8;
+    bool reduce_enabled = true;
+    OutputMerge output_merge = OutputMerge::concat;
+    size_t cluster_workers = 0;
+    std::filesystem::path scratch_root = ".";
+    std::optional<MapOutputCache> map_cache;
+    std::string map_cache_version;
+    size_t cache_block_size = 64 * 1024 * 1024;
+    // флаг досрочного завершения текущего запуска
+    std::shared_ptr<CancellationToken> cancellation = std::make_shared<CancellationToken>();
+    // отпечатки блоков текущего запуска (пусто - кэш не используется) и блоки, взятые из кэша
+    std::vector<std::string> block_fingerprints;
+    std::vector<char> cached_blocks;
+    // рабочий каталог промежуточных файлов, создаётся при первом запуске
+    std::optional<ScratchDirectory> scratch;
+    size_t max_task_attempts = 3;
+    // 0 - без спекулятивного выполнения
+    double speculation_slowdown = 0;
+    // как часто ожидающий фазу поток проверяет отстающие задачи
+    static constexpr std::chrono::milliseconds speculation_period{ 50 };
+    InputCache input_cache;
+    mutable StatsRecorder recorder;
+    // отсортированные файлы каждого раздела последнего запуска
+    std::vector<std::vector<std::string>> sorted_partitions;
 
-    std::function<std::pair<std::string, std::string>(std::string)> mapper;
-    std::function<bool(std::string, std::pair<std::string, std::string>)> reducer;
+    // цикл маппера по блоку, инстанцированный для типа маппера, и маппер одной строки для выборки ключей
+    std::function<void(const MapReduce&, const std::vector<InputFile>&, const Block&, const TaskAttempt&)> block_mapper;
+    std::function<Key(std::string_view)> sample_mapper;
+    Reducer reducer;
+    Combiner combiner;
+    Partitioner partitioner = hash_partitioner;
+    bool custom_partitioner = false;
+    bool range_partitioning = false;
+    size_t samples_per_partition = 100;
+    bool split_heavy_keys = false;
+    RangePartitioner<Key> ranges;
+    // промежуточные данные в памяти (Shuffle::memory), на него ссылается spill_io
+    std::shared_ptr<ShuffleStore> shuffle_store;
+    SpillIO<Key, Value> spill_io;
+    std::shared_ptr<ThreadPool> pool;
 };
\ No newline at end of file
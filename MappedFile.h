@@ -0,0 +1,152 @@
+#pragma once
+/**
+ * Отображение входного файла в память только для чтения.
+ *
+ * Файл отображается один раз, после чего мапперы получают std::string_view на свой блок
+ * и разбирают строки прямо в отображённой памяти, без копирования в std::string.
+ * Под Windows отображение не используется - файл целиком читается в буфер.
+ */
+#include <filesystem>
+#include <string_view>
+#include <string>
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), path.string());
+        buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path.string());
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), path.string());
+        }
+        size = static_cast<size_t>(st.st_size);
+
+        //файл нулевой длины отобразить нельзя, да и не нужно
+        if (size != 0)
+        {
+            void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                auto err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), path.string());
+            }
+            //файл читается блоками от начала к концу - просим ядро читать с опережением
+            ::madvise(addr, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(addr);
+        }
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data != nullptr)
+            ::munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    size_t file_size() const
+    {
+        return size;
+    }
+
+    std::string_view view() const
+    {
+        return std::string_view(data, size);
+    }
+
+    // Диапазон [from, to)
+    std::string_view view(size_t from, size_t to) const
+    {
+        return view().substr(from, to - from);
+    }
+
+    // Позиция первого перевода строки начиная с pos (или размер файла, если его нет)
+    size_t find_line_end(size_t pos) const
+    {
+        if (pos >= size)
+            return size;
+        auto p = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+        return p != nullptr ? static_cast<size_t>(p - data) : size;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::string buffer;
+#endif
+};
+
+/**
+ * Последовательно выдаёт непустые строки текста.
+ * Поиск перевода строки выполняется через memchr, который в стандартной библиотеке векторизован,
+ * поэтому на каждый символ не тратится ни вызов потока, ни ветвление в нашем коде.
+ */
+class LineReader
+{
+public:
+    explicit LineReader(std::string_view _text)
+        : text(_text)
+    {
+
+    }
+
+    bool next(std::string_view& line)
+    {
+        while (!text.empty())
+        {
+            auto p = static_cast<const char*>(std::memchr(text.data(), '\n', text.size()));
+            auto len = p != nullptr ? static_cast<size_t>(p - text.data()) : text.size();
+            line = text.substr(0, len);
+            text.remove_prefix(p != nullptr ? len + 1 : len);
+            if (len != 0)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::string_view text;
+};
+
+// Перебирает непустые строки текста
+template <typename F>
+void for_each_line(std::string_view text, F&& f)
+{
+    LineReader reader(text);
+    std::string_view line;
+    while (reader.next(line))
+        f(line);
+}
@@ -0,0 +1,55 @@
+#pragma once
+/**
+ * Разбиение ключей по разделам диапазонами (как в TeraSort).
+ *
+ * Границы диапазонов - квантили выборки ключей: раздел i получает ключи из (splits[i - 1], splits[i]].
+ * Поэтому разделы примерно равны по числу записей при любом распределении ключей,
+ * а все ключи раздела i меньше ключей раздела i + 1 - вместе разделы образуют отсортированный результат.
+ *
+ * Тяжёлый ключ, который занимает в выборке несколько квантилей подряд, целиком попал бы в один раздел.
+ * Если редьюсер ассоциативен (результат по ключу можно собрать из результатов по частям его значений),
+ * записи такого ключа можно распределять по всем занятым им разделам по кругу.
+ */
+#include <algorithm>
+#include <vector>
+
+template <typename Key>
+class RangePartitioner
+{
+public:
+    void build(std::vector<Key> samples, size_t partitions_count, bool _split_heavy_keys)
+    {
+        split_heavy_keys = _split_heavy_keys;
+        splits.clear();
+        if (samples.empty() || partitions_count < 2)
+            return;
+
+        std::sort(samples.begin(), samples.end());
+        splits.reserve(partitions_count - 1);
+        for (size_t i = 1; i < partitions_count; ++i)
+            splits.push_back(samples[samples.size() * i / partitions_count]);
+    }
+
+    // Номер раздела ключа. spread - счётчик вызывающего для распределения тяжёлых ключей по кругу.
+    // Ключ может быть любого типа, сравнимого с Key (например, std::string_view для std::string)
+    template <typename K>
+    size_t operator()(const K& key, size_t& spread) const
+    {
+        auto first = std::lower_bound(splits.begin(), splits.end(), key);
+        auto partition = static_cast<size_t>(first - splits.begin());
+        if (!split_heavy_keys || first == splits.end() || key < *first)
+            return partition;
+
+        //ключ совпадает с границами [first, last): ему принадлежат разделы с first до last включительно.
+        //Совпадение с одной границей - обычный ключ, тяжёлый занимает целый раздел и больше
+        auto last = std::upper_bound(first, splits.end(), key);
+        auto count = static_cast<size_t>(last - first) + 1;
+        if (count < 3)
+            return partition;
+        return partition + spread++ % count;
+    }
+
+private:
+    std::vector<Key> splits;
+    bool split_heavy_keys = false;
+};
@@ -0,0 +1,69 @@
+#pragma once
+/**
+ * Рабочий каталог задачи MapReduce для промежуточных файлов: выходов мапперов, прогонов, слияний и результатов редьюсеров.
+ *
+ * Каждая задача получает свой подкаталог корня root с уникальным именем mapreduce-<pid>-<номер>,
+ * поэтому задачи в одном процессе и в разных процессах не пересекаются по именам файлов,
+ * а корень можно вынести на быстрый локальный диск. Каталог создаётся в конструкторе
+ * и удаляется со всем содержимым в деструкторе.
+ */
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+
+class ScratchDirectory
+{
+public:
+    explicit ScratchDirectory(const std::filesystem::path& root)
+    {
+        static std::atomic<uint64_t> counter{ 0 };
+#ifndef _WIN32
+        auto pid = static_cast<uint64_t>(::getpid());
+#else
+        auto pid = static_cast<uint64_t>(::_getpid());
+#endif
+        std::filesystem::create_directories(root);
+        //каталог с таким именем мог остаться от упавшего процесса с тем же pid
+        do
+        {
+            dir = root / ("mapreduce-" + std::to_string(pid) + "-" + std::to_string(counter.fetch_add(1)));
+        } while (!std::filesystem::create_directory(dir));
+    }
+
+    ~ScratchDirectory()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(dir, error);
+    }
+
+    ScratchDirectory(const ScratchDirectory&) = delete;
+    ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+
+    const std::filesystem::path& path() const
+    {
+        return dir;
+    }
+
+    // Полное имя файла name в каталоге
+    std::string file(const std::string& name) const
+    {
+        return (dir / name).string();
+    }
+
+    // Удаляет всё содержимое, оставляя сам каталог
+    void clear() const
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(dir))
+            std::filesystem::remove_all(entry.path());
+    }
+
+private:
+    std::filesystem::path dir;
+};
@@ -0,0 +1,127 @@
+#pragma once
+/**
+ * Преобразование типизированных данных MapReduce.
+ *
+ * InputParser<T> - как из строки входного файла получить аргумент маппера.
+ * Serializer<T>  - как ключи и значения превращаются в байты записей промежуточных файлов (см. SpillFile.h).
+ * TextFormatter<T> - как ключи и значения результата редьюсеров записываются в текст выходного файла.
+ *
+ * Для своих типов достаточно специализировать нужный шаблон.
+ * Числа и прочие типы фиксированной ширины пишутся как есть, без форматирования и разбора текста.
+ * Длину байтового представления хранит сам формат файла, поэтому строки пишутся без разделителей.
+ */
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <stdexcept>
+#include <utility>
+
+template <typename T, typename Enable = void>
+struct InputParser
+{
+    // std::string_view, std::string и всё, что из них конструируется
+    static T parse(std::string_view line)
+    {
+        return T(line);
+    }
+};
+
+template <typename T>
+struct InputParser<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+    static T parse(std::string_view line)
+    {
+        T value{};
+        std::from_chars(line.data(), line.data() + line.size(), value);
+        return value;
+    }
+};
+
+template <typename T, typename Enable = void>
+struct Serializer;
+
+// Типы фиксированной ширины (числа, std::array<char, N>, простые структуры)
+template <typename T>
+struct Serializer<T, std::enable_if_t<std::is_trivially_copyable_v<T>>>
+{
+    // Дописывает байты значения в конец out
+    static void write(std::string& out, const T& value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Восстанавливает значение из его байтов. Другой размер - значит, запись повреждена или записана другим типом
+    static void read(std::string_view bytes, T& value)
+    {
+        if (bytes.size() != sizeof(T))
+            throw std::runtime_error("corrupted spill record: value size mismatch");
+        std::memcpy(&value, bytes.data(), sizeof(T));
+    }
+};
+
+template <>
+struct Serializer<std::string>
+{
+    static void write(std::string& out, const std::string& value)
+    {
+        out.append(value);
+    }
+
+    static void read(std::string_view bytes, std::string& value)
+    {
+        value.assign(bytes);
+    }
+};
+
+// Строки, хранящиеся в арене маппера (см. Arena.h), пишутся так же, как std::string
+template <>
+struct Serializer<std::string_view>
+{
+    static void write(std::string& out, std::string_view value)
+    {
+        out.append(value);
+    }
+};
+
+template <typename T, typename Enable = void>
+struct TextFormatter
+{
+    // std::string, std::string_view и всё, что в них преобразуется
+    static void write(std::string& out, const T& value)
+    {
+        out.append(std::string_view(value));
+    }
+};
+
+template <typename T>
+struct TextFormatter<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+{
+    static void write(std::string& out, T value)
+    {
+        char buffer[64];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+};
+
+template <>
+struct TextFormatter<bool>
+{
+    static void write(std::string& out, bool value)
+    {
+        out.push_back(value ? '1' : '0');
+    }
+};
+
+// Записи упорядочиваются только по ключу: значения не обязаны быть сравнимыми
+template <typename Key, typename Value>
+struct KeyLess
+{
+    bool operator()(const std::pair<Key, Value>& lhs, const std::pair<Key, Value>& rhs) const
+    {
+        return lhs.first < rhs.first;
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+/**
+ * Хранилище промежуточных данных MapReduce в памяти.
+ *
+ * Сегмент - содержимое промежуточного файла (в том же блочном формате SpillFile.h) под его именем.
+ * Пока суммарный объём сегментов не превышает порог, SpillWriter складывает данные сюда,
+ * а SpillReader читает их прямо из памяти - файлы не создаются.
+ * Сегмент, который не помещается под порог, пишется на диск как обычный файл.
+ *
+ * Одно хранилище может быть общим для нескольких задач: порог тогда - общий бюджет памяти shuffle,
+ * а имена сегментов разных задач различаются каталогом задачи (см. ScratchDirectory.h).
+ */
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class ShuffleStore
+{
+public:
+    explicit ShuffleStore(size_t _spill_threshold)
+        : spill_threshold(_spill_threshold)
+    {
+
+    }
+
+    ShuffleStore(const ShuffleStore&) = delete;
+    ShuffleStore& operator=(const ShuffleStore&) = delete;
+
+    // Занимает bytes под будущий сегмент. false - порог превышен, данные нужно писать на диск
+    bool reserve(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (used + bytes > spill_threshold)
+            return false;
+        used += bytes;
+        return true;
+    }
+
+    void release(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        used -= std::min(used, bytes);
+    }
+
+    // Сохраняет сегмент. reserved - сколько байт под него уже занято через reserve,
+    // остальное учитывается без проверки порога (маленькие сегменты вроде результатов редьюсеров)
+    void put(const std::string& name, std::string data, size_t reserved = 0)
+    {
+        auto segment = std::make_shared<const std::string>(std::move(data));
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& slot = segments[name];
+        if (slot)
+            used -= std::min(used, slot->size());
+        used = used - std::min(used, reserved) + segment->size();
+        slot = std::move(segment);
+    }
+
+    // Сегмент с таким именем или nullptr, если его нет в памяти
+    std::shared_ptr<const std::string> find(const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = segments.find(name);
+        return it != segments.end() ? it->second : nullptr;
+    }
+
+    // Удаляет сегмент, возвращает false, если его не было в памяти
+    bool remove(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = segments.find(name);
+        if (it == segments.end())
+            return false;
+        used -= std::min(used, it->second->size());
+        segments.erase(it);
+        return true;
+    }
+
+    // Удаляет сегменты, имена которых начинаются с prefix (например, файлы одной задачи в общем хранилище)
+    void remove_prefix(const std::string& prefix)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = segments.begin(); it != segments.end();)
+        {
+            if (it->first.compare(0, prefix.size(), prefix) == 0)
+            {
+                used -= std::min(used, it->second->size());
+                it = segments.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        segments.clear();
+        used = 0;
+    }
+
+    size_t used_bytes() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return used;
+    }
+
+private:
+    size_t spill_threshold;
+    mutable std::mutex mutex;
+    size_t used = 0;
+    std::unordered_map<std::string, std::shared_ptr<const std::string>> segments;
+};
@@ -0,0 +1,472 @@
+#pragma once
+/**
+ * Двоичный формат промежуточных файлов MapReduce (mapped_*, reduce_*).
+ *
+ * Файл - последовательность блоков. Заголовок блока:
+ *   размер данных блока (4 байта), размер записанных данных (4 байта), кодек (1 байт).
+ * Данные блока - записи вида: длина ключа (varint), байты ключа, длина значения (varint), байты значения.
+ * Если включено сжатие и оно выгодно, данные блока хранятся сжатыми LzCodec.
+ *
+ * Длины записываются явно, поэтому ключи и значения могут содержать любые байты, включая пробелы и переводы строк.
+ * SpillReader читает файл целыми блоками и отдаёт записи как string_view на буфер текущего блока,
+ * память на каждую запись не выделяется.
+ *
+ * Файлы читаются с опережением и пишутся с отложенной записью через AsyncIO.h,
+ * поэтому разбор и слияние записей идут одновременно с обменом с диском.
+ *
+ * Если передано хранилище ShuffleStore, файл пишется в память, пока хватает порога хранилища,
+ * и читается из памяти без копирования несжатых блоков. На диск попадают только не поместившиеся файлы.
+ *
+ * Файл появляется под своим именем целиком и только при close: на диске он пишется во временный файл
+ * и переименовывается, в памяти сохраняется одним сегментом. Писатель, разрушенный без close
+ * (например, при исключении в задаче), не оставляет ничего, поэтому повторная попытка задачи
+ * никогда не увидит и не оставит после себя недописанный файл.
+ */
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <atomic>
+#include <utility>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "AsyncIO.h"
+#include "LzCodec.h"
+#include "Serializer.h"
+#include "ShuffleStore.h"
+
+namespace spill
+{
+    enum Codec : uint8_t
+    {
+        codec_none = 0,
+        codec_lz = 1
+    };
+
+    constexpr size_t default_block_size = 64 * 1024;
+    constexpr size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+
+    inline void write_varint(std::string& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline bool read_varint(std::string_view& in, uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; !in.empty() && shift < 64; shift += 7)
+        {
+            auto byte = static_cast<uint8_t>(in.front());
+            in.remove_prefix(1);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Уникальное имя временного файла рядом с fname (уникально и между процессами локального кластера)
+    inline std::string temporary_name(const std::string& fname)
+    {
+        static std::atomic<uint64_t> counter{ 0 };
+        auto name = fname + ".tmp";
+#ifndef _WIN32
+        name += "." + std::to_string(::getpid());
+#endif
+        return name + "." + std::to_string(counter.fetch_add(1));
+    }
+}
+
+/**
+ * Запись байт файла: в хранилище store, пока хватает его порога, иначе в файл.
+ * store == nullptr - запись сразу в файл. Файл становится виден только после close.
+ */
+class SegmentWriter
+{
+public:
+    explicit SegmentWriter(const std::string& _fname, ShuffleStore* _store = nullptr)
+        : fname(_fname), store(_store)
+    {
+        if (store == nullptr)
+            open_file();
+    }
+
+    // Без close записанное отбрасывается
+    ~SegmentWriter()
+    {
+        discard();
+    }
+
+    SegmentWriter(SegmentWriter&& other) noexcept
+        : fname(std::move(other.fname)), temporary_fname(std::move(other.temporary_fname)), store(other.store),
+          out(std::move(other.out)), memory(std::move(other.memory)),
+          reserved(std::exchange(other.reserved, 0)), closed(std::exchange(other.closed, true))
+    {
+
+    }
+
+    void write(const char* data, size_t size)
+    {
+        if (!out)
+        {
+            if (store->reserve(size))
+            {
+                memory.append(data, size);
+                reserved += size;
+                return;
+            }
+            //порог хранилища исчерпан: всё записанное и остальное - в файл
+            open_file();
+            out->write(memory.data(), memory.size());
+            store->release(reserved);
+            reserved = 0;
+            std::string().swap(memory);
+        }
+        out->write(data, size);
+    }
+
+    void close()
+    {
+        if (closed)
+            return;
+        if (!out)
+        {
+            closed = true;
+            store->put(fname, std::move(memory), std::exchange(reserved, 0));
+            //старый файл с тем же именем (например, от прошлой попытки) не должен остаться вместо сегмента
+            std::error_code error;
+            std::filesystem::remove(fname, error);
+            return;
+        }
+
+        out->close();
+        std::filesystem::rename(temporary_fname, fname);
+        closed = true;
+        //старый сегмент с тем же именем заслонил бы новый файл
+        if (store != nullptr)
+            store->remove(fname);
+    }
+
+    bool is_open() const
+    {
+        return !closed;
+    }
+
+private:
+    void open_file()
+    {
+        temporary_fname = spill::temporary_name(fname);
+        out.emplace(temporary_fname);
+    }
+
+    void discard() noexcept
+    {
+        if (closed)
+            return;
+        closed = true;
+        if (store != nullptr)
+            store->release(std::exchange(reserved, 0));
+        if (out)
+        {
+            try
+            {
+                out->close();
+            }
+            catch (...)
+            {
+            }
+            std::error_code error;
+            std::filesystem::remove(temporary_fname, error);
+        }
+    }
+
+    std::string fname;
+    std::string temporary_fname;
+    ShuffleStore* store;
+    std::optional<AsyncFileWriter> out;
+    std::string memory;
+    size_t reserved = 0;
+    bool closed = false;
+};
+
+class SpillWriter
+{
+public:
+    // store == nullptr - запись сразу в файл
+    explicit SpillWriter(const std::string& fname, bool _compress = false, size_t _block_size = spill::default_block_size,
+                         ShuffleStore* store = nullptr)
+        : out(fname, store), compress(_compress), block_size(_block_size)
+    {
+        block.reserve(block_size + block_size / 4);
+    }
+
+    SpillWriter(SpillWriter&&) = default;
+
+    void write(std::string_view key, std::string_view value)
+    {
+        spill::write_varint(block, key.size());
+        block.append(key);
+        spill::write_varint(block, value.size());
+        block.append(value);
+        if (block.size() >= block_size)
+            flush_block();
+    }
+
+    void close()
+    {
+        if (!out.is_open())
+            return;
+        flush_block();
+        out.close();
+    }
+
+private:
+    void flush_block()
+    {
+        if (block.empty())
+            return;
+
+        auto codec = spill::codec_none;
+        const std::string* payload = &block;
+        if (compress)
+        {
+            compressed.clear();
+            codec_state.compress(block.data(), block.size(), compressed);
+            if (compressed.size() < block.size())
+            {
+                codec = spill::codec_lz;
+                payload = &compressed;
+            }
+        }
+
+        char header[spill::header_size];
+        auto raw_size = static_cast<uint32_t>(block.size());
+        auto stored_size = static_cast<uint32_t>(payload->size());
+        std::memcpy(header, &raw_size, sizeof(raw_size));
+        std::memcpy(header + sizeof(raw_size), &stored_size, sizeof(stored_size));
+        header[2 * sizeof(uint32_t)] = static_cast<char>(codec);
+        out.write(header, sizeof(header));
+        out.write(payload->data(), payload->size());
+
+        block.clear();
+    }
+
+    SegmentWriter out;
+    bool compress;
+    size_t block_size;
+    std::string block;
+    std::string compressed;
+    LzCodec codec_state;
+};
+
+class SpillReader
+{
+public:
+    // Файл из хранилища store, если он там есть, иначе с диска
+    explicit SpillReader(const std::string& fname, const ShuffleStore* store = nullptr)
+        : segment(store != nullptr ? store->find(fname) : nullptr)
+    {
+        if (segment)
+            unread = *segment;
+        else
+            in.emplace(fname);
+    }
+
+    SpillReader(SpillReader&&) = default;
+
+    // Следующая запись. Ключ и значение действительны до следующего вызова next
+    bool next(std::string_view& key, std::string_view& value)
+    {
+        if (rest.empty() && !load_block())
+            return false;
+
+        uint64_t size;
+        if (!spill::read_varint(rest, size) || size > rest.size())
+            throw std::runtime_error("corrupted spill record");
+        key = rest.substr(0, size);
+        rest.remove_prefix(size);
+        if (!spill::read_varint(rest, size) || size > rest.size())
+            throw std::runtime_error("corrupted spill record");
+        value = rest.substr(0, size);
+        rest.remove_prefix(size);
+        return true;
+    }
+
+private:
+    bool load_block()
+    {
+        char header[spill::header_size];
+        if (read(header, sizeof(header)) != sizeof(header))
+            return false;
+
+        uint32_t raw_size, stored_size;
+        std::memcpy(&raw_size, header, sizeof(raw_size));
+        std::memcpy(&stored_size, header + sizeof(raw_size), sizeof(stored_size));
+        auto codec = static_cast<uint8_t>(header[2 * sizeof(uint32_t)]);
+
+        std::string_view payload;
+        if (segment)
+        {
+            if (unread.size() < stored_size)
+                throw std::runtime_error("truncated spill block");
+            payload = unread.substr(0, stored_size);
+            unread.remove_prefix(stored_size);
+        }
+        else
+        {
+            stored.resize(stored_size);
+            if (in->read(stored.data(), stored_size) != stored_size)
+                throw std::runtime_error("truncated spill block");
+            payload = stored;
+        }
+
+        if (codec == spill::codec_lz)
+        {
+            if (!LzCodec::decompress(payload.data(), payload.size(), block, raw_size))
+                throw std::runtime_error("corrupted spill block");
+            rest = block;
+        }
+        else if (codec == spill::codec_none && raw_size == stored_size)
+            rest = payload;
+        else
+            throw std::runtime_error("unknown spill block codec");
+        return true;
+    }
+
+    size_t read(char* data, size_t size)
+    {
+        if (!segment)
+            return in->read(data, size);
+        size = std::min(size, unread.size());
+        std::memcpy(data, unread.data(), size);
+        unread.remove_prefix(size);
+        return size;
+    }
+
+    std::shared_ptr<const std::string> segment;
+    std::string_view unread;
+    std::optional<AsyncFileReader> in;
+    std::string block;
+    std::string stored;
+    std::string_view rest;
+};
+
+/**
+ * Чтение и запись типизированных пар ключ/значение в формате SpillWriter/SpillReader.
+ * Подходит в качестве IO для mergeFiles. Записи разбираются в переданный объект,
+ * поэтому при повторном использовании одной записи память под строки не перевыделяется.
+ */
+template <typename Key, typename Value>
+struct SpillIO
+{
+    using Record = std::pair<Key, Value>;
+
+    class Reader
+    {
+    public:
+        Reader(const std::string& fname, const ShuffleStore* store)
+            : reader(fname, store)
+        {
+
+        }
+
+        bool read(Record& record)
+        {
+            std::string_view key, value;
+            if (!reader.next(key, value))
+                return false;
+            Serializer<Key>::read(key, record.first);
+            Serializer<Value>::read(value, record.second);
+            return true;
+        }
+
+    private:
+        SpillReader reader;
+    };
+
+    class Writer
+    {
+    public:
+        Writer(const std::string& fname, bool compress, ShuffleStore* store)
+            : writer(fname, compress, spill::default_block_size, store)
+        {
+
+        }
+
+        // Кроме Record принимает пары других типов с тем же байтовым представлением (например, std::string_view)
+        template <typename K, typename V>
+        void write(const std::pair<K, V>& record)
+        {
+            write(record.first, record.second);
+        }
+
+        template <typename K, typename V>
+        void write(const K& key, const V& value)
+        {
+            key_bytes.clear();
+            value_bytes.clear();
+            Serializer<K>::write(key_bytes, key);
+            Serializer<V>::write(value_bytes, value);
+            writer.write(key_bytes, value_bytes);
+        }
+
+        void close()
+        {
+            writer.close();
+        }
+
+    private:
+        SpillWriter writer;
+        std::string key_bytes;
+        std::string value_bytes;
+    };
+
+    Reader open_reader(const std::string& fname) const
+    {
+        return Reader(fname, store);
+    }
+
+    Writer open_writer(const std::string& fname) const
+    {
+        return Writer(fname, compress, store);
+    }
+
+    // Размер файла в байтах, 0 - если его нет
+    uint64_t size(const std::string& fname) const
+    {
+        if (store != nullptr)
+        {
+            if (auto segment = store->find(fname))
+                return segment->size();
+        }
+        std::error_code error;
+        auto file_size = std::filesystem::file_size(fname, error);
+        return error ? 0 : file_size;
+    }
+
+    bool exists(const std::string& fname) const
+    {
+        return (store != nullptr && store->find(fname)) || std::filesystem::exists(fname);
+    }
+
+    void remove(const std::string& fname) const
+    {
+        if (store == nullptr || !store->remove(fname))
+            std::filesystem::remove(fname);
+    }
+
+    bool compress = false;
+    // хранилище в памяти, nullptr - только файлы
+    ShuffleStore* store = nullptr;
+};
@@ -0,0 +1,338 @@
+#pragma once
+/**
+ * Статистика выполнения MapReduce::run.
+ *
+ * Каждая задача (разбиение входа, маппер, слияние, редьюсер, сборка результата) записывает
+ * время начала и длительность, номер потока пула, количество записей и байт на входе и выходе.
+ * По задачам строится сводка по фазам: сколько задач, суммарное и максимальное время задачи,
+ * поэтому отстающие задачи и перекос данных между блоками и разделами видны сразу.
+ *
+ * Статистику можно сохранить в JSON или в формате Chrome trace (chrome://tracing, Perfetto),
+ * где задачи рисуются на временной шкале по потокам.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+struct TaskStats
+{
+    std::string phase;
+    size_t index = 0;
+    // номер потока пула (или size() пула для потока, вызвавшего run)
+    size_t thread = 0;
+    // микросекунды от начала запуска
+    uint64_t start = 0;
+    uint64_t duration = 0;
+
+    uint64_t records_in = 0;
+    uint64_t records_out = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    // байты, записанные задачей в промежуточные файлы (включая временные)
+    uint64_t spill_bytes = 0;
+
+    // Двоичное представление для передачи между процессами (см. LocalCluster.h)
+    void write(std::string& out) const
+    {
+        auto phase_size = static_cast<uint32_t>(phase.size());
+        out.append(reinterpret_cast<const char*>(&phase_size), sizeof(phase_size));
+        out.append(phase);
+        for (auto value : { uint64_t(index), uint64_t(thread), start, duration, records_in, records_out, bytes_in, bytes_out, spill_bytes })
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    // Читает задачу из начала in, false - данные кончились или обрезаны
+    bool read(std::string_view& in)
+    {
+        uint32_t phase_size;
+        if (in.size() < sizeof(phase_size))
+            return false;
+        std::memcpy(&phase_size, in.data(), sizeof(phase_size));
+        uint64_t values[9];
+        if (in.size() < sizeof(phase_size) + phase_size + sizeof(values))
+            return false;
+        phase.assign(in.substr(sizeof(phase_size), phase_size));
+        std::memcpy(values, in.data() + sizeof(phase_size) + phase_size, sizeof(values));
+        in.remove_prefix(sizeof(phase_size) + phase_size + sizeof(values));
+        index = static_cast<size_t>(values[0]);
+        thread = static_cast<size_t>(values[1]);
+        start = values[2];
+        duration = values[3];
+        records_in = values[4];
+        records_out = values[5];
+        bytes_in = values[6];
+        bytes_out = values[7];
+        spill_bytes = values[8];
+        return true;
+    }
+};
+
+struct PhaseStats
+{
+    std::string name;
+    size_t tasks_count = 0;
+    // от начала первой до конца последней задачи фазы, микросекунды
+    uint64_t start = 0;
+    uint64_t end = 0;
+    // суммарное и максимальное время задач фазы
+    uint64_t busy = 0;
+    uint64_t max_task = 0;
+
+    uint64_t records_in = 0;
+    uint64_t records_out = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t spill_bytes = 0;
+
+    // Во сколько раз самая долгая задача дольше средней: 1 - нагрузка распределена идеально
+    double skew() const
+    {
+        return busy != 0 ? static_cast<double>(max_task) * tasks_count / busy : 1.0;
+    }
+};
+
+// Пиковый объём занятой процессом памяти (resident set) за всё время его работы в байтах, 0 - если неизвестен
+inline uint64_t process_peak_memory_usage()
+{
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (::getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+class JobStats
+{
+public:
+    std::vector<TaskStats> tasks;
+    uint64_t total_time = 0;
+    uint64_t spill_bytes = 0;
+    // пик памяти всего процесса, а не запуска: в нём учтены и прошлые, и одновременные задачи процесса
+    uint64_t process_peak_memory = 0;
+    // запуск завершён досрочно (см. MapReduce::cancellation_token), результат частичный
+    bool cancelled = false;
+
+    // Сводка по фазам в порядке появления их первых задач
+    std::vector<PhaseStats> phases() const
+    {
+        std::vector<PhaseStats> result;
+        for (const auto& task : tasks)
+        {
+            auto it = std::find_if(result.begin(), result.end(), [&task](const PhaseStats& phase) { return phase.name == task.phase; });
+            if (it == result.end())
+            {
+                result.emplace_back();
+                it = std::prev(result.end());
+                it->name = task.phase;
+                it->start = task.start;
+            }
+            auto& phase = *it;
+            ++phase.tasks_count;
+            phase.start = std::min(phase.start, task.start);
+            phase.end = std::max(phase.end, task.start + task.duration);
+            phase.busy += task.duration;
+            phase.max_task = std::max(phase.max_task, task.duration);
+            phase.records_in += task.records_in;
+            phase.records_out += task.records_out;
+            phase.bytes_in += task.bytes_in;
+            phase.bytes_out += task.bytes_out;
+            phase.spill_bytes += task.spill_bytes;
+        }
+        return result;
+    }
+
+    void write_json(std::ostream& out) const
+    {
+        out << "{\n  \"total_time_us\": " << total_time
+            << ",\n  \"spill_bytes\": " << spill_bytes
+            << ",\n  \"process_peak_memory_bytes\": " << process_peak_memory
+            << ",\n  \"cancelled\": " << (cancelled ? "true" : "false")
+            << ",\n  \"phases\": [";
+        auto phases_stats = phases();
+        for (size_t i = 0; i < phases_stats.size(); ++i)
+        {
+            const auto& phase = phases_stats[i];
+            out << (i != 0 ? "," : "") << "\n    {\"name\": ";
+            write_string(out, phase.name);
+            out << ", \"tasks\": " << phase.tasks_count
+                << ", \"start_us\": " << phase.start
+                << ", \"end_us\": " << phase.end
+                << ", \"busy_us\": " << phase.busy
+                << ", \"max_task_us\": " << phase.max_task
+                << ", \"skew\": " << phase.skew()
+                << ", \"records_in\": " << phase.records_in
+                << ", \"records_out\": " << phase.records_out
+                << ", \"bytes_in\": " << phase.bytes_in
+                << ", \"bytes_out\": " << phase.bytes_out
+                << ", \"spill_bytes\": " << phase.spill_bytes << "}";
+        }
+        out << "\n  ],\n  \"tasks\": [";
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            const auto& task = tasks[i];
+            out << (i != 0 ? "," : "") << "\n    {\"phase\": ";
+            write_string(out, task.phase);
+            out << ", \"index\": " << task.index
+                << ", \"thread\": " << task.thread
+                << ", \"start_us\": " << task.start
+                << ", \"duration_us\": " << task.duration;
+            write_counters(out, task);
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // Формат Trace Event: полные события ("ph": "X") с потоком пула в качестве tid
+    void write_chrome_trace(std::ostream& out) const
+    {
+        out << "{\"traceEvents\": [";
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            const auto& task = tasks[i];
+            out << (i != 0 ? "," : "") << "\n  {\"name\": ";
+            write_string(out, task.phase + " " + std::to_string(task.index));
+            out << ", \"cat\": ";
+            write_string(out, task.phase);
+            out << ", \"ph\": \"X\", \"pid\": 1"
+                << ", \"tid\": " << task.thread
+                << ", \"ts\": " << task.start
+                << ", \"dur\": " << task.duration
+                << ", \"args\": {\"index\": " << task.index;
+            write_counters(out, task);
+            out << "}}";
+        }
+        out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    }
+
+private:
+    // Строка JSON в кавычках: кавычки, обратная косая черта и управляющие символы экранируются,
+    // поэтому любое имя фазы (в том числе полученное от рабочего кластера) даёт корректный JSON
+    static void write_string(std::ostream& out, std::string_view value)
+    {
+        static constexpr char hex_digits[] = "0123456789abcdef";
+        out << '"';
+        for (char c : value)
+        {
+            switch (c)
+            {
+            case '"':
+                out << "\\\"";
+                break;
+            case '\\':
+                out << "\\\\";
+                break;
+            case '\n':
+                out << "\\n";
+                break;
+            case '\r':
+                out << "\\r";
+                break;
+            case '\t':
+                out << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                    out << "\\u00" << hex_digits[c >> 4] << hex_digits[c & 0xf];
+                else
+                    out << c;
+            }
+        }
+        out << '"';
+    }
+
+    static void write_counters(std::ostream& out, const TaskStats& task)
+    {
+        out << ", \"records_in\": " << task.records_in
+            << ", \"records_out\": " << task.records_out
+            << ", \"bytes_in\": " << task.bytes_in
+            << ", \"bytes_out\": " << task.bytes_out
+            << ", \"spill_bytes\": " << task.spill_bytes;
+    }
+};
+
+/**
+ * Собирает статистику задач одного запуска. Задачи завершаются в разных потоках,
+ * поэтому добавление защищено мьютексом (один раз на задачу, а не на запись).
+ */
+class StatsRecorder
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void start()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = JobStats{};
+        started = Clock::now();
+    }
+
+    TaskStats begin(std::string phase, size_t index, size_t thread) const
+    {
+        TaskStats task;
+        task.phase = std::move(phase);
+        task.index = index;
+        task.thread = thread;
+        task.start = elapsed();
+        return task;
+    }
+
+    void end(TaskStats& task)
+    {
+        task.duration = elapsed() - task.start;
+        add(std::move(task));
+    }
+
+    // Добавляет уже завершённую задачу, например выполненную в другом процессе
+    void add(TaskStats task)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.spill_bytes += task.spill_bytes;
+        stats.tasks.push_back(std::move(task));
+    }
+
+    // Забирает записанные задачи, не завершая запуск
+    std::vector<TaskStats> take_tasks()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.spill_bytes = 0;
+        return std::exchange(stats.tasks, {});
+    }
+
+    JobStats finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.total_time = elapsed();
+        stats.process_peak_memory = process_peak_memory_usage();
+        std::sort(stats.tasks.begin(), stats.tasks.end(), [](const TaskStats& lhs, const TaskStats& rhs) { return lhs.start < rhs.start; });
+        return stats;
+    }
+
+private:
+    uint64_t elapsed() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - started).count());
+    }
+
+    std::mutex mutex;
+    Clock::time_point started = Clock::now();
+    JobStats stats;
+};
@@ -0,0 +1,319 @@
+#pragma once
+/**
+ * Попытки выполнения задач одной фазы: повтор после исключения и запасные (спекулятивные) попытки отстающих задач.
+ *
+ * Задача выполняется до max_attempts раз, пока одна из попыток не завершится успешно.
+ * Если включено спекулятивное выполнение, задача, которая выполняется дольше slowdown медиан
+ * уже завершённых задач фазы, получает вторую попытку в свободном потоке.
+ * Засчитывается первая успешная попытка: commit вызывается для задачи ровно один раз,
+ * а опоздавшая попытка видит cancelled() и прекращает работу при ближайшей проверке.
+ *
+ * Поэтому попытки должны быть идемпотентными: попытки одной задачи пишут одни и те же файлы,
+ * которые появляются атомарно (см. SpillFile.h), и повторная запись заменяет файл тем же содержимым.
+ * Файлы делаются видимыми через TaskAttempt::publish под той же блокировкой задачи, под которой засчитывается
+ * попытка: опоздавшая попытка не может опубликовать файлы после того, как засчитанная отдала свои следующей фазе,
+ * которая могла уже прочитать и удалить их.
+ *
+ * Вся фаза прерывается флагом CancellationToken: попытки видят его через тот же cancelled(),
+ * новые попытки не начинаются, а прерванные не повторяются и не считаются ошибкой.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/**
+ * Флаг досрочного завершения задачи MapReduce: код, которому уже известен ответ (например, редьюсер
+ * задачи-предиката, нашедший первый пример), вызывает cancel(), и все задачи запуска останавливаются
+ * при ближайшей проверке. Взводится из любого потока.
+ */
+class CancellationToken
+{
+public:
+    void cancel() noexcept
+    {
+        flag.store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const noexcept
+    {
+        return flag.load(std::memory_order_relaxed);
+    }
+
+    void reset() noexcept
+    {
+        flag.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> flag{ false };
+};
+
+// Прерывает попытку, результат которой уже не нужен
+struct AttemptCancelled : std::exception
+{
+    const char* what() const noexcept override
+    {
+        return "task attempt cancelled";
+    }
+};
+
+class TaskAttempt
+{
+public:
+    // Попытка без повторов и замен
+    TaskAttempt() = default;
+
+    // _publish_mutex - блокировка задачи, под которой засчитывается попытка, nullptr - других попыток нет
+    TaskAttempt(const std::atomic<bool>* _committed, size_t _number, const CancellationToken* _job = nullptr,
+                std::mutex* _publish_mutex = nullptr)
+        : committed(_committed), job(_job), publish_mutex(_publish_mutex), number(_number)
+    {
+
+    }
+
+    // Номер попытки задачи, 0 - первая
+    size_t attempt_number() const
+    {
+        return number;
+    }
+
+    // Задача уже выполнена другой попыткой или весь запуск завершается досрочно
+    bool cancelled() const
+    {
+        return superseded() || job_cancelled();
+    }
+
+    // Задачу выполнила другая попытка
+    bool superseded() const
+    {
+        return committed != nullptr && committed->load(std::memory_order_relaxed);
+    }
+
+    bool job_cancelled() const
+    {
+        return job != nullptr && job->cancelled();
+    }
+
+    void check() const
+    {
+        if (cancelled())
+            throw AttemptCancelled();
+    }
+
+    // Делает результат попытки видимым (например, закрывает её файлы), только если задача ещё не засчитана:
+    // проверка и publish выполняются атомарно относительно засчитывания другой попытки
+    template <typename F>
+    void publish(F&& make_visible) const
+    {
+        std::unique_lock<std::mutex> lock;
+        if (publish_mutex != nullptr)
+            lock = std::unique_lock<std::mutex>(*publish_mutex);
+        check();
+        make_visible();
+    }
+
+private:
+    const std::atomic<bool>* committed = nullptr;
+    const CancellationToken* job = nullptr;
+    std::mutex* publish_mutex = nullptr;
+    size_t number = 0;
+};
+
+class PhaseAttempts
+{
+public:
+    using Body = std::function<void(const TaskAttempt&)>;
+    using Commit = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    // slowdown == 0 - без спекулятивного выполнения
+    PhaseAttempts(ThreadPool::TaskGroup& _group, size_t _max_attempts, double _slowdown, const CancellationToken* _job = nullptr)
+        : group(_group), max_attempts(std::max<size_t>(_max_attempts, 1)), slowdown(_slowdown), job(_job)
+    {
+
+    }
+
+    // Попытки ставятся в группу, поэтому их нужно дождаться, даже если группу не дождались
+    ~PhaseAttempts()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queued == 0 && active == 0; });
+    }
+
+    PhaseAttempts(const PhaseAttempts&) = delete;
+    PhaseAttempts& operator=(const PhaseAttempts&) = delete;
+
+    // Запускает задачу. commit вызывается после первой успешной попытки в её потоке
+    void run(Body body, Commit commit = {})
+    {
+        auto task = std::make_shared<Task>();
+        task->body = std::move(body);
+        task->commit = std::move(commit);
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+        launch(task);
+    }
+
+    // Запускает запасные попытки задачам, которые выполняются намного дольше медианы фазы
+    void speculate()
+    {
+        if (slowdown <= 0 || job_cancelled())
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        //пока в очереди есть попытки, свободных потоков для запасных нет
+        if (queued != 0 || durations.empty())
+            return;
+
+        auto median = durations;
+        std::nth_element(median.begin(), median.begin() + median.size() / 2, median.end());
+        auto limit = std::chrono::duration_cast<Clock::duration>(median[median.size() / 2] * slowdown);
+        auto now = Clock::now();
+        for (const auto& task : tasks)
+        {
+            if (!task->speculated && task->running != 0 && !task->committed.load() && now - task->started > limit)
+            {
+                task->speculated = true;
+                launch(task);
+            }
+        }
+    }
+
+private:
+    struct Task
+    {
+        Body body;
+        Commit commit;
+        std::atomic<bool> committed{ false };
+        // засчитывание попытки и публикация результатов попыток (см. TaskAttempt::publish)
+        std::mutex publish_mutex;
+
+        // под mutex фазы
+        size_t launched = 0;
+        size_t failures = 0;
+        size_t running = 0;
+        bool speculated = false;
+        Clock::time_point started;
+    };
+
+    // Вызывается под mutex
+    void launch(const std::shared_ptr<Task>& task)
+    {
+        auto number = task->launched++;
+        ++queued;
+        group.run([this, task, number] { execute(task, number); });
+    }
+
+    void execute(const std::shared_ptr<Task>& task, size_t number)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --queued;
+            ++active;
+            if (task->running++ == 0 && number == task->failures)
+                task->started = Clock::now();
+        }
+
+        bool stopped = task->committed.load() || job_cancelled();
+        try
+        {
+            if (!stopped)
+                task->body(TaskAttempt(&task->committed, number, job, &task->publish_mutex));
+        }
+        catch (const AttemptCancelled&)
+        {
+            //запуск прерван или задачу выполнила другая попытка
+            stopped = true;
+        }
+        catch (...)
+        {
+            bool rethrow = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --task->running;
+                if (!task->committed.load())
+                {
+                    if (++task->failures < max_attempts && !job_cancelled())
+                        launch(task);
+                    else
+                        rethrow = task->running == 0;
+                }
+            }
+            finish();
+            if (rethrow)
+                throw;
+            return;
+        }
+
+        if (stopped)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --task->running;
+            }
+            finish();
+            return;
+        }
+
+        //публикующая файлы попытка держит только блокировку задачи, а не всей фазы
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> publish_lock(task->publish_mutex);
+            first = !task->committed.exchange(true);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --task->running;
+            if (first)
+                durations.push_back(std::chrono::duration<double>(Clock::now() - task->started));
+        }
+        try
+        {
+            if (first && task->commit)
+                task->commit();
+            //освободившийся поток может сразу взять запасную попытку; после finish фаза может быть уже разрушена
+            speculate();
+        }
+        catch (...)
+        {
+            finish();
+            throw;
+        }
+        finish();
+    }
+
+    bool job_cancelled() const
+    {
+        return job != nullptr && job->cancelled();
+    }
+
+    // Последнее обращение попытки к фазе: как только active станет 0, деструктор может её разрушить,
+    // поэтому уведомление отправляется под mutex, а после finish попытка не трогает this
+    void finish()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        --active;
+        idle.notify_all();
+    }
+
+    ThreadPool::TaskGroup& group;
+    size_t max_attempts;
+    double slowdown;
+    const CancellationToken* job;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<std::shared_ptr<Task>> tasks;
+    // время выполнения засчитанных задач, секунды
+    std::vector<std::chrono::duration<double>> durations;
+    size_t queued = 0;
+    size_t active = 0;
+};
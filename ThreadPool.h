@@ -0,0 +1,325 @@
+#pragma once
+/**
+ * Постоянный пул потоков с перехватом задач (work stealing).
+ *
+ * У каждого рабочего потока своя очередь задач. Поток берёт задачи из конца своей очереди,
+ * а когда она пуста - забирает задачи из начала очередей других потоков.
+ * Поэтому если одни задачи оказались дольше других, освободившиеся потоки разбирают оставшиеся,
+ * а не простаивают до общего join.
+ *
+ * Потоки создаются один раз и переиспользуются всеми запусками MapReduce::run.
+ * Задачи объединяются в TaskGroup, ожидание группы не блокирует поток впустую:
+ * пока задачи группы не завершены, ожидающий сам выполняет задачи из очередей.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t threads_count)
+    {
+        threads_count = std::max<size_t>(threads_count, 1);
+        for (size_t i = 0; i < threads_count; ++i)
+            queues.emplace_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < threads_count; ++i)
+            threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const
+    {
+        return threads.size();
+    }
+
+    // Число аппаратных потоков машины (1, если оно неизвестно): больше потоков в пуле только конкурируют за ядра
+    static size_t hardware_threads()
+    {
+        return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    // Номер рабочего потока, выполняющего текущий код, или size() для потоков вне пула
+    size_t current_thread() const
+    {
+        auto self = current_worker();
+        return self != no_worker ? self : threads.size();
+    }
+
+    // Ставит задачу в очередь. Из рабочего потока - в его собственную очередь, иначе - по кругу
+    void submit(Task task)
+    {
+        auto self = current_worker();
+        auto index = self != no_worker ? self : next_queue.fetch_add(1) % queues.size();
+        //счётчик увеличивается до постановки в очередь, чтобы не уйти в минус, если задачу заберут сразу
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            ++queued;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Выполняет одну задачу из очередей, если она есть
+    bool run_pending_task()
+    {
+        Task task;
+        if (!take_task(current_worker(), task))
+            return false;
+        task();
+        task = nullptr;
+        task_done();
+        return true;
+    }
+
+    /**
+     * Ждёт, пока в очередях не останется задач и ни один поток пула не будет выполнять задачу.
+     * Простаивающие потоки ждут на condition variable и не держат блокировок, поэтому после wait_idle
+     * процесс можно копировать через fork (см. LocalCluster.h), если никто не ставит новые задачи.
+     * Вызывается вне потоков пула.
+     */
+    void wait_idle()
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        idle.wait(lock, [this] { return queued.load() == 0 && running.load() == 0; });
+    }
+
+    /**
+     * Группа задач, завершения которых можно дождаться.
+     * Первое исключение, выброшенное задачей группы, пробрасывается из wait.
+     */
+    class TaskGroup
+    {
+    public:
+        explicit TaskGroup(ThreadPool& _pool)
+            : pool(_pool)
+        {
+
+        }
+
+        ~TaskGroup()
+        {
+            wait_all();
+        }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(Task task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++pending;
+            }
+            pool.submit([this, task = std::move(task)]
+            {
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                finish();
+            });
+        }
+
+        void wait()
+        {
+            wait_all();
+            rethrow();
+        }
+
+        /**
+         * Как wait, но пока задачи группы не завершены, ожидающий поток не реже раза в period вызывает tick
+         * (например, чтобы следить за отстающими задачами и запускать им замену).
+         */
+        template <typename Tick>
+        void wait(Tick tick, std::chrono::milliseconds period)
+        {
+            while (!done())
+            {
+                if (!pool.run_pending_task())
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    finished.wait_for(lock, period, [this] { return pending == 0; });
+                }
+                tick();
+            }
+            rethrow();
+        }
+
+    private:
+        void rethrow()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (error)
+            {
+                auto rethrown = error;
+                error = nullptr;
+                std::rethrow_exception(rethrown);
+            }
+        }
+
+        void wait_all()
+        {
+            while (!done())
+            {
+                //помогаем выполнять задачи, пока они есть в очередях
+                if (pool.run_pending_task())
+                    continue;
+                std::unique_lock<std::mutex> lock(mutex);
+                finished.wait(lock, [this] { return pending == 0; });
+            }
+        }
+
+        bool done()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pending == 0;
+        }
+
+        void finish()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                finished.notify_all();
+        }
+
+        ThreadPool& pool;
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t pending = 0;
+        std::exception_ptr error;
+    };
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static constexpr size_t no_worker = static_cast<size_t>(-1);
+
+    // Номер рабочего потока этого пула, выполняющего текущий код
+    size_t current_worker() const
+    {
+        return worker_pool == this ? worker_index : no_worker;
+    }
+
+    bool take_task(size_t self, Task& task)
+    {
+        if (queued.load() == 0)
+            return false;
+
+        //сначала своя очередь (последняя добавленная задача - её данные ещё в кэше)
+        if (self != no_worker)
+        {
+            std::lock_guard<std::mutex> lock(queues[self]->mutex);
+            auto& tasks = queues[self]->tasks;
+            if (!tasks.empty())
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                ++running;
+                --queued;
+                return true;
+            }
+        }
+
+        //затем перехватываем самую старую задачу у других потоков
+        auto start = self != no_worker ? self + 1 : 0;
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            auto& queue = *queues[(start + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty())
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+                ++running;
+                --queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void task_done()
+    {
+        //блокировка берётся только для последней задачи: ожидающий wait_idle проверяет условие под ней
+        if (running.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            idle.notify_all();
+        }
+    }
+
+    void worker_loop(size_t index)
+    {
+        worker_pool = this;
+        worker_index = index;
+
+        Task task;
+        while (true)
+        {
+            if (take_task(index, task))
+            {
+                task();
+                task = nullptr;
+                task_done();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [this] { return stop || queued.load() != 0; });
+            if (stop && queued.load() == 0)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::atomic<size_t> queued{ 0 };
+    // задачи, взятые из очередей и ещё не завершённые (running увеличивается раньше, чем уменьшается queued)
+    std::atomic<size_t> running{ 0 };
+    std::atomic<size_t> next_queue{ 0 };
+    bool stop = false;
+
+    static inline thread_local const ThreadPool* worker_pool = nullptr;
+    static inline thread_local size_t worker_index = 0;
+};
@@ -0,0 +1,143 @@
+#pragma once
+/**
+ * Генератор синтетических входных файлов для бенчмарков: одна строка - одна запись.
+ *
+ * Управляемые параметры:
+ *   размер файла и диапазон длин строк;
+ *   перекос ключей - строки выбираются из keys_count различных строк с частотами по закону Ципфа
+ *     с показателем skew (0 - равномерно), keys_count == 0 - каждая строка новая;
+ *   глубина общих префиксов - каждая новая строка начинается с одной из prefixes_count заготовок
+ *     длины prefix_depth, поэтому строки различаются только после этого префикса.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+struct DataGeneratorOptions
+{
+    uint64_t bytes = 64 * 1024 * 1024;
+    size_t min_line = 8;
+    size_t max_line = 32;
+    size_t keys_count = 0;
+    double skew = 0.0;
+    size_t prefixes_count = 1024;
+    size_t prefix_depth = 0;
+    uint64_t seed = 1;
+};
+
+// Размер вида 100, 64K, 256M, 2G
+inline uint64_t parse_size(const std::string& text)
+{
+    size_t pos = 0;
+    uint64_t value = std::stoull(text, &pos);
+    if (pos == text.size())
+        return value;
+    switch (text[pos])
+    {
+    case 'k': case 'K': return value << 10;
+    case 'm': case 'M': return value << 20;
+    case 'g': case 'G': return value << 30;
+    default: throw std::invalid_argument("bad size: " + text);
+    }
+}
+
+class DataGenerator
+{
+public:
+    explicit DataGenerator(const DataGeneratorOptions& _options)
+        : options(_options), rng(_options.seed)
+    {
+        if (options.max_line < options.min_line)
+            options.max_line = options.min_line;
+        //строка длиннее префикса хотя бы на один символ, иначе все строки с одной заготовкой совпадут
+        options.min_line = std::max(options.min_line, options.prefix_depth + 1);
+        options.max_line = std::max(options.max_line, options.min_line);
+
+        if (options.prefix_depth != 0)
+            for (size_t i = 0; i < options.prefixes_count; ++i)
+                prefixes.push_back(random_string(options.prefix_depth));
+
+        if (options.keys_count != 0)
+        {
+            double total = 0;
+            for (size_t i = 0; i < options.keys_count; ++i)
+            {
+                keys.push_back(fresh_line());
+                total += 1.0 / std::pow(static_cast<double>(i + 1), options.skew);
+                cdf.push_back(total);
+            }
+            for (auto& p : cdf)
+                p /= total;
+        }
+    }
+
+    // Следующая строка (без перевода строки)
+    const std::string& next()
+    {
+        if (keys.empty())
+        {
+            line = fresh_line();
+            return line;
+        }
+        auto p = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        auto i = static_cast<size_t>(std::lower_bound(cdf.begin(), cdf.end(), p) - cdf.begin());
+        return keys[std::min(i, keys.size() - 1)];
+    }
+
+    void write_file(const std::string& fname)
+    {
+        auto file = std::fopen(fname.c_str(), "wb");
+        if (file == nullptr)
+            throw std::system_error(errno, std::generic_category(), fname);
+
+        std::string buffer;
+        buffer.reserve(1 << 20);
+        uint64_t written = 0;
+        while (written < options.bytes)
+        {
+            const auto& text = next();
+            buffer.append(text);
+            buffer.push_back('\n');
+            written += text.size() + 1;
+            if (buffer.size() >= (1 << 20))
+            {
+                std::fwrite(buffer.data(), 1, buffer.size(), file);
+                buffer.clear();
+            }
+        }
+        std::fwrite(buffer.data(), 1, buffer.size(), file);
+        std::fclose(file);
+    }
+
+private:
+    std::string random_string(size_t length)
+    {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+        std::string text(length, ' ');
+        for (auto& ch : text)
+            ch = alphabet[rng() % (sizeof(alphabet) - 1)];
+        return text;
+    }
+
+    std::string fresh_line()
+    {
+        auto length = options.min_line + rng() % (options.max_line - options.min_line + 1);
+        if (prefixes.empty())
+            return random_string(length);
+        const auto& prefix = prefixes[rng() % prefixes.size()];
+        return prefix + random_string(length - prefix.size());
+    }
+
+    DataGeneratorOptions options;
+    std::mt19937_64 rng;
+    std::vector<std::string> prefixes;
+    std::vector<std::string> keys;
+    std::vector<double> cdf;
+    std::string line;
+};
@@ -0,0 +1,56 @@
+/**
+ * Генератор входных файлов для бенчмарков (см. DataGenerator.h).
+ *
+ * Запуск: datagen <output> [--size 1G] [--line-min 8] [--line-max 32]
+ *                 [--keys N --skew S] [--prefixes P --prefix-depth D] [--seed N]
+ */
+#include "DataGenerator.h"
+
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, const char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <output> [--size 1G] [--line-min 8] [--line-max 32]"
+                  << " [--keys N --skew S] [--prefixes P --prefix-depth D] [--seed N]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    DataGeneratorOptions options;
+    try
+    {
+        for (int i = 2; i + 1 < argc; i += 2)
+        {
+            std::string name = argv[i];
+            std::string value = argv[i + 1];
+            if (name == "--size")
+                options.bytes = parse_size(value);
+            else if (name == "--line-min")
+                options.min_line = std::stoul(value);
+            else if (name == "--line-max")
+                options.max_line = std::stoul(value);
+            else if (name == "--keys")
+                options.keys_count = std::stoul(value);
+            else if (name == "--skew")
+                options.skew = std::stod(value);
+            else if (name == "--prefixes")
+                options.prefixes_count = std::stoul(value);
+            else if (name == "--prefix-depth")
+                options.prefix_depth = std::stoul(value);
+            else if (name == "--seed")
+                options.seed = std::stoull(value);
+            else
+                throw std::invalid_argument("unknown option " + name);
+        }
+
+        DataGenerator(options).write_file(argv[1]);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
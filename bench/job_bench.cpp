@@ -0,0 +1,135 @@
+/**
+ * Время фаз MapReduce на синтетическом или заданном входе.
+ *
+ * Сначала отдельно измеряются шаги, из которых состоит задача маппера, на одном блоке входа:
+ *   parse     - разбор строк (LineReader) и вызов маппера, ключи копируются в арену,
+ *   sort      - сортировка результата маппера (sort_records по кэшированным префиксам ключей, как в задаче),
+ *   partition - раскладка отсортированных записей по файлам разделов.
+ * Затем задача (подсчёт повторов строк с combiner) целиком выполняется на 1, 2, 4, ... потоках,
+ * и для каждого запуска печатается время фаз по статистике JobStats (см. Stats.h).
+ *
+ * Запуск: job_bench [входной файл | размер, например 256M] [max threads] [pipelined 0|1]
+ * Если передан размер, вход генерируется в bench_input.txt (см. DataGenerator.h).
+ */
+#include "DataGenerator.h"
+#include "MapReduce.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+namespace
+{
+    using BenchMapReduce = MapReduce<std::string, int>;
+    using Record = BenchMapReduce::Record;
+    // запись маппера в том виде, в каком её сортирует задача: ключ - ссылка на арену
+    using MapRecord = std::pair<std::string_view, int>;
+
+    template <typename F>
+    double seconds(F&& f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void bench_map_steps(const std::filesystem::path& input, size_t partitions_count)
+    {
+        MappedFile file(input);
+        //один блок - столько, сколько маппер сортирует в памяти по умолчанию
+        auto block = file.view(0, file.find_line_end(std::min<size_t>(file.file_size(), 64 * 1024 * 1024)));
+
+        Arena arena;
+        std::vector<MapRecord> records;
+        auto parse = seconds([&]
+        {
+            for_each_line(block, [&records, &arena](std::string_view line) { records.emplace_back(ArenaStorage<std::string>::store(line, arena), 1); });
+        });
+        auto sort = seconds([&] { sort_records(records, KeyLess<std::string_view, int>{}); });
+
+        SpillIO<std::string, int> io;
+        auto partition = seconds([&]
+        {
+            std::vector<SpillIO<std::string, int>::Writer> files;
+            for (size_t i = 0; i < partitions_count; ++i)
+                files.emplace_back(io.open_writer("bench_partition_" + std::to_string(i)));
+            for (const auto& record : records)
+                files[std::hash<std::string_view>{}(record.first) % partitions_count].write(record);
+            for (auto& f : files)
+                f.close();
+        });
+        for (size_t i = 0; i < partitions_count; ++i)
+            std::filesystem::remove("bench_partition_" + std::to_string(i));
+
+        auto mb = block.size() / 1e6;
+        std::printf("map steps on one %.1f MB block (%zu records)\n", mb, records.size());
+        std::printf("%12s %10s %10s\n", "step", "ms", "MB/s");
+        std::printf("%12s %10.1f %10.1f\n", "parse", parse * 1e3, mb / parse);
+        std::printf("%12s %10.1f %10.1f\n", "sort", sort * 1e3, mb / sort);
+        std::printf("%12s %10.1f %10.1f\n\n", "partition", partition * 1e3, mb / partition);
+    }
+
+    void bench_job(const std::filesystem::path& input, size_t threads, bool pipelined)
+    {
+        BenchMapReduce mr(threads, threads);
+        mr.set_pipelined(pipelined);
+        mr.set_mapper([](std::string_view line) { return Record(std::string(line), 1); });
+        mr.set_combiner(std::plus<int>());
+        mr.set_reducer([](const std::string& line, BenchMapReduce::Values& repeats, BenchMapReduce::Output& output)
+        {
+            int total = 0;
+            for (auto count : repeats)
+                total += count;
+            output.emit(line, total);
+        });
+
+        auto stats = mr.run(input, "bench_output");
+        std::filesystem::remove("bench_output");
+        auto phases = stats.phases();
+        auto find_phase = [&phases](const std::string& name)
+        {
+            return std::find_if(phases.begin(), phases.end(), [&name](const PhaseStats& phase) { return phase.name == name; });
+        };
+
+        std::printf("%8zu %10.1f", threads, stats.total_time / 1e3);
+        for (const auto* name : { "split", "map", "map merge", "merge", "reduce", "output" })
+        {
+            auto it = find_phase(name);
+            if (it != phases.end())
+                std::printf(" %10.1f", (it->end - it->start) / 1e3);
+            else
+                std::printf(" %10s", "-");
+        }
+        auto map = find_phase("map");
+        std::printf(" %9.1fM %9.2f\n", stats.spill_bytes / 1e6, map != phases.end() ? map->skew() : 1.0);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    std::string source = argc > 1 ? argv[1] : "256M";
+    size_t max_threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    bool pipelined = argc > 3 ? std::stoi(argv[3]) != 0 : true;
+
+    std::filesystem::path input(source);
+    if (!std::filesystem::exists(input))
+    {
+        DataGeneratorOptions options;
+        options.bytes = parse_size(source);
+        options.prefix_depth = 4;
+        input = "bench_input.txt";
+        auto generate = seconds([&] { DataGenerator(options).write_file(input.string()); });
+        std::printf("generated %s (%.1f MB) in %.1f s\n\n", input.string().c_str(), options.bytes / 1e6, generate);
+    }
+
+    bench_map_steps(input, 4 * max_threads);
+
+    std::printf("end-to-end, ms (pipelined = %d)\n", pipelined ? 1 : 0);
+    std::printf("%8s %10s %10s %10s %10s %10s %10s %10s %10s %9s\n",
+        "threads", "total", "split", "map", "map merge", "merge", "reduce", "output", "spill", "map skew");
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+        bench_job(input, threads, pipelined);
+
+    return EXIT_SUCCESS;
+}
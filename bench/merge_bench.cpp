@@ -0,0 +1,136 @@
+/**
+ * Пропускная способность k-путевого слияния в зависимости от количества прогонов.
+ *
+ * Для каждого k создаются k отсортированных прогонов в формате SpillFile (всего records записей),
+ * после чего они сливаются двумя способами:
+ *   loser_tree     - mergeFiles из ExternalMergeSort.h (дерево проигравших),
+ *   priority_queue - прежняя схема на std::priority_queue с копированием узлов (для сравнения).
+ *
+ * Запуск: merge_bench [records] [string|uint64]
+ */
+#include "ExternalMergeSort.h"
+#include "SpillFile.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <queue>
+#include <random>
+
+namespace
+{
+    template <typename Key>
+    Key make_key(std::mt19937_64& rng);
+
+    template <>
+    uint64_t make_key<uint64_t>(std::mt19937_64& rng)
+    {
+        return rng();
+    }
+
+    template <>
+    std::string make_key<std::string>(std::mt19937_64& rng)
+    {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789.@";
+        std::string key(8 + rng() % 16, ' ');
+        for (auto& ch : key)
+            ch = alphabet[rng() % (sizeof(alphabet) - 1)];
+        return key;
+    }
+
+    template <typename Key>
+    std::vector<std::string> make_runs(size_t k, size_t records)
+    {
+        using Record = std::pair<Key, uint64_t>;
+        std::mt19937_64 rng(k);
+        SpillIO<Key, uint64_t> io;
+
+        std::vector<std::string> files;
+        for (size_t i = 0; i < k; ++i)
+        {
+            std::vector<Record> run(records / k + (i < records % k ? 1 : 0));
+            for (auto& record : run)
+                record = Record(make_key<Key>(rng), rng());
+            std::sort(run.begin(), run.end(), KeyLess<Key, uint64_t>{});
+
+            files.push_back("bench_run_" + std::to_string(i));
+            auto writer = io.open_writer(files.back());
+            for (const auto& record : run)
+                writer.write(record);
+            writer.close();
+        }
+        return files;
+    }
+
+    // Слияние кучей с копированием узлов, как было до перехода на дерево проигравших
+    template <typename Key>
+    void merge_priority_queue(const std::string& output_file, const std::vector<std::string>& input_files)
+    {
+        using Record = std::pair<Key, uint64_t>;
+        struct Node
+        {
+            Record element;
+            size_t i;
+        };
+        auto greater = [](const Node& lhs, const Node& rhs) { return rhs.element.first < lhs.element.first; };
+
+        SpillIO<Key, uint64_t> io;
+        auto in = openReaders(input_files, io);
+        auto out = io.open_writer(output_file);
+        std::priority_queue<Node, std::vector<Node>, decltype(greater)> pq(greater);
+        for (size_t i = 0; i < in.size(); ++i)
+        {
+            Node node{ {}, i };
+            if (in[i].read(node.element))
+                pq.push(node);
+        }
+        while (!pq.empty())
+        {
+            Node root = pq.top();
+            pq.pop();
+            out.write(root.element);
+            if (in[root.i].read(root.element))
+                pq.push(root);
+        }
+        out.close();
+    }
+
+    template <typename F>
+    double seconds(F&& f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    template <typename Key>
+    void run_bench(size_t records)
+    {
+        using Record = std::pair<Key, uint64_t>;
+        std::printf("%8s %16s %16s %10s\n", "runs", "loser_tree Mrec/s", "heap Mrec/s", "speedup");
+        for (size_t k = 2; k <= 512; k *= 2)
+        {
+            auto files = make_runs<Key>(k, records);
+            auto loser_tree = seconds([&] { mergeFiles<Record, SpillIO<Key, uint64_t>, KeyLess<Key, uint64_t>>("bench_merged", files, {}, SpillIO<Key, uint64_t>{}); });
+            auto heap = seconds([&] { merge_priority_queue<Key>("bench_merged", files); });
+            std::printf("%8zu %16.2f %16.2f %9.2fx\n", k, records / loser_tree / 1e6, records / heap / 1e6, heap / loser_tree);
+
+            for (const auto& file : files)
+                std::filesystem::remove(file);
+        }
+        std::filesystem::remove("bench_merged");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t records = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    std::string key_type = argc > 2 ? argv[2] : "string";
+
+    if (key_type == "uint64")
+        run_bench<uint64_t>(records);
+    else
+        run_bench<std::string>(records);
+
+    return EXIT_SUCCESS;
+}
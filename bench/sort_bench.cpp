@@ -0,0 +1,79 @@
+/**
+ * Сортировка прогона маппера: std::sort с KeyLess (как раньше) против сортировки по кэшированному префиксу
+ * из KeySort.h в одном потоке и с раздачей корзин в пул потоков.
+ *
+ * Записи - пары (std::string_view, int), как в прогоне маппера со строками в арене.
+ * Ключи генерируются DataGenerator с разной глубиной общего префикса: чем он длиннее,
+ * тем чаще совпадают первые 8 байт и тем чаще приходится сравнивать строки целиком.
+ *
+ * Запуск: sort_bench [records] [threads]
+ */
+#include "DataGenerator.h"
+#include "KeySort.h"
+#include "Serializer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+namespace
+{
+    using Record = std::pair<std::string_view, int>;
+
+    template <typename F>
+    double seconds(F&& f)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run_bench(size_t records_count, size_t prefix_depth, ThreadPool& pool)
+    {
+        DataGeneratorOptions options;
+        options.prefix_depth = prefix_depth;
+        options.min_line = 8;
+        options.max_line = 32;
+        DataGenerator generator(options);
+
+        std::vector<std::string> keys;
+        keys.reserve(records_count);
+        for (size_t i = 0; i < records_count; ++i)
+            keys.push_back(generator.next());
+        std::vector<Record> input;
+        input.reserve(records_count);
+        for (const auto& key : keys)
+            input.emplace_back(key, 1);
+
+        KeyLess<std::string_view, int> less;
+        auto records = input;
+        auto std_sort = seconds([&] { std::sort(records.begin(), records.end(), less); });
+        auto expected = records;
+
+        records = input;
+        auto prefix_sort = seconds([&] { sort_records(records, less); });
+        bool ok = records == expected;
+
+        records = input;
+        auto parallel_sort = seconds([&] { sort_records(records, less, &pool); });
+        ok = ok && records == expected;
+
+        std::printf("%12zu %10.1f %12.1f %14.1f %9.2fx %9.2fx%s\n", prefix_depth,
+            std_sort * 1e3, prefix_sort * 1e3, parallel_sort * 1e3, std_sort / prefix_sort, std_sort / parallel_sort,
+            ok ? "" : "  MISMATCH");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    size_t records = argc > 1 ? std::stoull(argv[1]) : 2000000;
+    size_t threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(threads);
+
+    std::printf("%zu records, %zu threads, ms\n", records, threads);
+    std::printf("%12s %10s %12s %14s %10s %10s\n", "prefix depth", "std::sort", "prefix sort", "parallel sort", "speedup", "parallel");
+    for (size_t depth : { 0, 4, 8, 12 })
+        run_bench(records, depth, pool);
+
+    return EXIT_SUCCESS;
+}
@@ -1,71 +1,104 @@
 #include "MapReduce.h"
 #include <iostream>
 #include <string>
+#include <algorithm>
 /**
  * В этом файле находится клиентский код, который использует наш MapReduce фреймворк.
  * Этот код знает о том, какую задачу мы решаем.
  * Задача этого кода - верно написать мапер, редьюсер, запустить mapreduce задачу, обработать результат.
  * Задача - найти минимальную длину префикса, который позволяет однозначно идентифицировать строку в файле.
- * Задача не решается в одну mapreduce задачу. Нужно делать несколько запусков.
- * 
- * Выделяем первые буквы слов (в мапере), решаем для них задачу "определить, есть ли в них повторы".
- * Если не прокатило, повторяем процедуру, выделяя первые две буквы.
- * И т.д. В итоге найдём длину префикса, который однозначно определяет строку.
+ * Минимальная длина префикса, различающего все строки, на единицу больше наибольшего общего префикса
+ * двух строк. А наибольший общий префикс всегда достигается на паре соседних строк в отсортированном порядке.
+ *
+ * Поэтому вместо запуска задачи для каждой длины префикса строки один раз сортируются фреймворком (MapReduce::sort),
+ * после чего каждый раздел за один проход находит наибольший общий префикс соседних строк (fold_partitions).
+ * Разделы упорядочены по диапазонам строк, так что остаётся сравнить ещё только строки на границах разделов.
  */
+
+// Итог прохода по одному разделу
+struct PrefixSummary
+{
+    std::string first;
+    std::string last;
+    size_t max_common_prefix = 0;
+    bool empty = true;
+};
+
+size_t common_prefix(const std::string& lhs, const std::string& rhs)
+{
+    auto [l, r] = std::mismatch(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    return static_cast<size_t>(l - lhs.begin());
+}
+
 int main(int argc, const char* argv[]) 
 {
     if (argc < 4) 
     {
-        std::cerr << "Usage: " << argv[0] << " <src> " << "<map threads count> " << "<reduce threads count>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <src file, directory or pattern> " << "<map threads count> " << "<reduce threads count> " << "[trace file]" << std::endl;
         return EXIT_FAILURE;
     }
     std::filesystem::path input(argv[1]);
-    std::filesystem::path output("output");
     size_t mappers_count = atoi(argv[2]);
     size_t reducers_count = atoi(argv[3]);
 
-    MapReduce mr(mappers_count, reducers_count);
-    int found = 0;
-    int prefix_len = 1;
-    do
+    using PrefixMapReduce = MapReduce<std::string, int>;
+    //промежуточные данные держим в памяти, на диск уходит только то, что не помещается в порог
+    PrefixMapReduce mr(mappers_count, reducers_count, PrefixMapReduce::Shuffle::memory);
+    mr.set_pipelined(true);
+
+    //  * получает строку,
+    //  * возвращает пару (строка, 1). Строка не копируется в std::string - фреймворк сложит её в арену маппера
+    mr.set_mapper([](std::string_view word)
     {
-        //  * получает строку, 
-        //  * выделяет префикс, 
-        //  * возвращает пары (префикс, 1).
-        auto mapper = [prefix_len](const std::string& word) 
-        {
-            return std::pair{ word.substr(0,prefix_len), std::to_string(1) };
-        };
-        mr.set_mapper(mapper);
+        return std::pair{ word, 1 };
+    });
 
-        //  * получает строку(предыдущий префикс) и пару (текущий префикс, число),
-        //  * если текущий префикс совпадает с предыдущим или имеет кол-во повторов > 1, то возвращает false,
-        //  * иначе возвращает true.
-        auto reducer = [](std::string last_prefix, std::pair<std::string, std::string> prefix_to_repeats)
-        {
-            if (prefix_to_repeats.first == last_prefix || atoi(prefix_to_repeats.second.c_str())>1)
-                return false;
-            return true;
-        };
+    //  * складывает количество повторов одной строки ещё на стороне маппера
+    mr.set_combiner(std::plus<int>());
 
-        mr.set_reducer(reducer);
+    //  * раскладывает строки по разделам диапазонами так, что все строки раздела i меньше строк раздела i + 1,
+    //  * а разделы примерно равны по размеру при любом распределении строк
+    mr.set_range_partitioning(true);
 
-        mr.run(input, output);
+    auto stats = mr.sort(input);
+    //  * по желанию сохраняет временную шкалу задач для chrome://tracing
+    if (argc > 4)
+    {
+        std::ofstream trace(argv[4]);
+        stats.write_chrome_trace(trace);
+    }
 
-        //Читаем результаты
-        std::ifstream results(output);
-        std::string line;
-        while (std::getline(results, line))
+    //  * идёт по строкам раздела по возрастанию,
+    //  * запоминает первую и последнюю строку и наибольший общий префикс соседних строк.
+    //  * Повторяющаяся строка не различается никаким префиксом, для неё общий префикс - вся строка.
+    auto summaries = mr.fold_partitions<PrefixSummary>([](PrefixSummary& summary, const PrefixMapReduce::Record& record)
+    {
+        const auto& [word, repeats] = record;
+        if (summary.empty)
         {
-            found = std::atoi(line.c_str());
-            if (!found)
-            {
-                ++prefix_len;
-                break;
-            }
+            summary.first = word;
+            summary.empty = false;
         }
-        results.close();
-    } while (!found);
+        else
+            summary.max_common_prefix = std::max(summary.max_common_prefix, common_prefix(summary.last, word));
+        if (repeats > 1)
+            summary.max_common_prefix = std::max(summary.max_common_prefix, word.size());
+        summary.last = word;
+    });
+
+    //Сводим результаты разделов, сравнивая соседние строки на границах разделов
+    size_t max_common_prefix = 0;
+    const std::string* previous = nullptr;
+    for (const auto& summary : summaries)
+    {
+        if (summary.empty)
+            continue;
+        max_common_prefix = std::max(max_common_prefix, summary.max_common_prefix);
+        if (previous != nullptr)
+            max_common_prefix = std::max(max_common_prefix, common_prefix(*previous, summary.first));
+        previous = &summary.last;
+    }
+    size_t prefix_len = max_common_prefix + 1;
 
     std::cout << "Minimal prefix len = " << prefix_len;
 
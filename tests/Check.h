@@ -0,0 +1,44 @@
+#pragma once
+/**
+ * Проверки тестов фреймворка.
+ *
+ * Каждый тест - отдельная программа без сторонних библиотек. Первая неудачная проверка печатает
+ * условие и место и завершает программу с ненулевым кодом, который ctest засчитывает как ошибку.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+[[noreturn]] inline void check_failed(const char* condition, const char* file, int line)
+{
+    std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+    std::exit(EXIT_FAILURE);
+}
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+            check_failed(#condition, __FILE__, __LINE__); \
+    } while (false)
+
+// Записывает строки в файл, каждую с переводом строки
+inline void write_lines(const std::filesystem::path& path, const std::vector<std::string>& lines)
+{
+    std::ofstream out(path, std::ios::binary);
+    for (const auto& line : lines)
+        out << line << '\n';
+    CHECK(out.good());
+}
+
+// Содержимое файла целиком
+inline std::string read_file(const std::filesystem::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    CHECK(in.good());
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
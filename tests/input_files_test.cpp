@@ -0,0 +1,74 @@
+/**
+ * Входные файлы задачи: сопоставление с шаблоном и раскрытие каталогов и шаблонов (InputFiles.h).
+ */
+#include "InputFiles.h"
+#include "Check.h"
+
+namespace
+{
+    void test_match_wildcard()
+    {
+        using input_files::match_wildcard;
+        CHECK(match_wildcard("*", ""));
+        CHECK(match_wildcard("*", "anything"));
+        CHECK(match_wildcard("", ""));
+        CHECK(!match_wildcard("", "a"));
+        CHECK(match_wildcard("app.log", "app.log"));
+        CHECK(!match_wildcard("app.log", "app.log1"));
+        CHECK(match_wildcard("app.log.*", "app.log.1"));
+        CHECK(match_wildcard("app.log.*", "app.log."));
+        CHECK(!match_wildcard("app.log.*", "app.log"));
+        CHECK(match_wildcard("?", "x"));
+        CHECK(!match_wildcard("?", ""));
+        CHECK(!match_wildcard("?", "xy"));
+        CHECK(match_wildcard("a?c", "abc"));
+        CHECK(!match_wildcard("a?c", "ac"));
+        //* возвращается назад, если первое совпадение хвоста неудачно
+        CHECK(match_wildcard("*.txt", "a.txt.txt"));
+        CHECK(match_wildcard("a*b*c", "aXbYbZc"));
+        CHECK(!match_wildcard("a*b*c", "aXbYbZ"));
+        CHECK(match_wildcard("**?", "z"));
+        CHECK(match_wildcard("*a*", "bab"));
+        CHECK(!match_wildcard("*a*", "bbb"));
+    }
+
+    void test_expand_input_paths(const std::filesystem::path& dir)
+    {
+        auto logs = dir / "logs";
+        std::filesystem::create_directories(logs / "nested");
+        for (const auto* name : { "app.log.2", "app.log.10", "app.log.1", "other.txt" })
+            write_lines(logs / name, { name });
+        write_lines(logs / "nested" / "app.log.3", { "nested" });
+        write_lines(dir / "single.txt", { "single" });
+
+        //каталог - только его обычные файлы по возрастанию имён, шаблон - подходящие из них
+        auto files = expand_input_paths({ dir / "single.txt", logs / "app.log.*", logs });
+        std::vector<std::filesystem::path> expected = {
+            dir / "single.txt",
+            logs / "app.log.1", logs / "app.log.10", logs / "app.log.2",
+            logs / "app.log.1", logs / "app.log.10", logs / "app.log.2", logs / "other.txt"
+        };
+        CHECK(files == expected);
+
+        //шаблон без совпадений даёт пустой список, а путь без шаблона остаётся как есть, даже если файла нет
+        CHECK(expand_input_paths({ logs / "*.csv" }).empty());
+        CHECK(expand_input_paths({ dir / "missing.txt" }) == std::vector<std::filesystem::path>{ dir / "missing.txt" });
+
+        //существующий файл с символами шаблона в имени не раскрывается
+        write_lines(logs / "literal?", { "literal" });
+        CHECK(expand_input_paths({ logs / "literal?" }) == std::vector<std::filesystem::path>{ logs / "literal?" });
+    }
+}
+
+int main()
+{
+    auto dir = std::filesystem::absolute("input_files_test_data");
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    test_match_wildcard();
+    test_expand_input_paths(dir);
+
+    std::filesystem::remove_all(dir);
+    return EXIT_SUCCESS;
+}
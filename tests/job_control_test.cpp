@@ -0,0 +1,252 @@
+/**
+ * Управление выполнением задачи: повтор упавших попыток, досрочное завершение (CancellationToken)
+ * и кэш выходов мапперов (MapOutputCache.h).
+ *
+ * Каждый запуск - подсчёт строк, результат сравнивается с подсчётом в одном потоке. Попадания в кэш
+ * видны по статистике: задача fingerprint с records_out == 1 - блок взят из кэша, а маппер его не читает.
+ */
+#include "MapReduce.h"
+#include "Check.h"
+
+#include <atomic>
+#include <map>
+#include <sstream>
+
+namespace
+{
+    using CountMapReduce = MapReduce<std::string, int>;
+    using Counts = std::map<std::string, int>;
+
+    std::vector<std::string> make_lines(size_t count)
+    {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < count; ++i)
+            lines.push_back("line" + std::to_string(i * 7919 % 1000));
+        return lines;
+    }
+
+    Counts count_lines(const std::vector<std::string>& lines)
+    {
+        Counts counts;
+        for (const auto& line : lines)
+            ++counts[line];
+        return counts;
+    }
+
+    Counts read_counts(const std::filesystem::path& path)
+    {
+        Counts counts;
+        std::istringstream in(read_file(path));
+        std::string key;
+        int count;
+        while (std::getline(in, key, '\t') && in >> count)
+        {
+            CHECK(counts.emplace(key, count).second);
+            in.ignore();
+        }
+        return counts;
+    }
+
+    // Подсчёт строк; mapped считает вызовы маппера
+    void configure(CountMapReduce& mr, std::atomic<size_t>& mapped)
+    {
+        mr.set_output_merge(CountMapReduce::OutputMerge::sorted);
+        mr.set_mapper([&mapped](std::string_view line)
+        {
+            ++mapped;
+            return std::pair{ line, 1 };
+        });
+        mr.set_reducer([](const std::string& key, CountMapReduce::Values& values, CountMapReduce::Output& output)
+        {
+            int sum = 0;
+            for (auto value : values)
+                sum += value;
+            output.emit(key, sum);
+        });
+    }
+
+    size_t phase_tasks(const JobStats& stats, const std::string& name)
+    {
+        for (const auto& phase : stats.phases())
+        {
+            if (phase.name == name)
+                return phase.tasks_count;
+        }
+        return 0;
+    }
+
+    // Число блоков, взятых из кэша
+    size_t cache_hits(const JobStats& stats)
+    {
+        for (const auto& phase : stats.phases())
+        {
+            if (phase.name == "fingerprint")
+                return phase.records_out;
+        }
+        return 0;
+    }
+
+    void test_retry(const std::filesystem::path& dir, const std::filesystem::path& input, const Counts& expected)
+    {
+        auto output = dir / "retry.txt";
+        for (bool pipelined : { false, true })
+        {
+            //первые две попытки map и первая попытка reduce падают, третья попытка задачи проходит
+            std::atomic<int> map_failures{ 0 }, reduce_failures{ 0 };
+            CountMapReduce mr(3, 2);
+            mr.set_scratch_directory(dir);
+            mr.set_pipelined(pipelined, 2);
+            mr.set_output_merge(CountMapReduce::OutputMerge::sorted);
+            mr.set_mapper([&map_failures](std::string_view line)
+            {
+                if (map_failures.fetch_add(1) < 2)
+                    throw std::runtime_error("map failure");
+                return std::pair{ line, 1 };
+            });
+            mr.set_reducer([&reduce_failures](const std::string& key, CountMapReduce::Values& values, CountMapReduce::Output& output)
+            {
+                int sum = 0;
+                for (auto value : values)
+                    sum += value;
+                output.emit(key, sum);
+                if (reduce_failures.fetch_add(1) == 0)
+                    throw std::runtime_error("reduce failure");
+            });
+            mr.run(input, output);
+            CHECK(read_counts(output) == expected);
+
+            //без повторов ошибка задачи - ошибка запуска
+            map_failures = 0;
+            mr.set_task_attempts(1);
+            bool failed = false;
+            try
+            {
+                mr.run(input, output);
+            }
+            catch (const std::runtime_error& e)
+            {
+                failed = std::string(e.what()) == "map failure";
+            }
+            CHECK(failed);
+        }
+    }
+
+    void test_cancellation(const std::filesystem::path& dir, const std::filesystem::path& input, const Counts& expected)
+    {
+        auto output = dir / "cancel.txt";
+        for (bool pipelined : { false, true })
+        {
+            std::atomic<size_t> mapped{ 0 };
+            CountMapReduce mr(3, 4);
+            mr.set_scratch_directory(dir);
+            mr.set_pipelined(pipelined, 2);
+            configure(mr, mapped);
+
+            //редьюсер находит первый ключ и останавливает запуск: в результате только верные счётчики
+            auto token = mr.cancellation_token();
+            mr.set_reducer([token](const std::string& key, CountMapReduce::Values& values, CountMapReduce::Output& output)
+            {
+                int sum = 0;
+                for (auto value : values)
+                    sum += value;
+                output.emit(key, sum);
+                token->cancel();
+            });
+            auto stats = mr.run(input, output);
+            CHECK(stats.cancelled);
+            auto counts = read_counts(output);
+            CHECK(!counts.empty() && counts.size() < expected.size());
+            for (const auto& [key, count] : counts)
+                CHECK(expected.at(key) == count);
+
+            //отмена на фазе map: редьюсеры не запускаются
+            mr.set_mapper([token](std::string_view line)
+            {
+                token->cancel();
+                return std::pair{ line, 1 };
+            });
+            stats = mr.run(input, output);
+            CHECK(stats.cancelled);
+            CHECK(read_counts(output).empty());
+
+            //флаг сбрасывается в начале следующего запуска
+            configure(mr, mapped);
+            stats = mr.run(input, output);
+            CHECK(!stats.cancelled);
+            CHECK(read_counts(output) == expected);
+        }
+    }
+
+    void test_map_cache(const std::filesystem::path& dir, const std::vector<std::string>& lines)
+    {
+        auto cache = dir / "cache";
+        auto input = dir / "cached_input.txt";
+        auto output = dir / "cached.txt";
+        write_lines(input, lines);
+
+        //каждый запуск - новый объект, как новый процесс: состояние переходит только через каталог кэша
+        auto run = [&](const std::string& version, std::atomic<size_t>& mapped)
+        {
+            CountMapReduce mr(2, 3);
+            mr.set_scratch_directory(dir);
+            configure(mr, mapped);
+            mr.set_map_cache(cache, version, 4096);
+            return mr.run(input, output);
+        };
+
+        //первый запуск мапит все блоки и сохраняет их
+        std::atomic<size_t> mapped{ 0 };
+        auto stats = run("v1", mapped);
+        auto blocks = phase_tasks(stats, "fingerprint");
+        CHECK(blocks > 4);
+        CHECK(cache_hits(stats) == 0);
+        CHECK(phase_tasks(stats, "map") == blocks);
+        CHECK(mapped == lines.size());
+        CHECK(read_counts(output) == count_lines(lines));
+
+        //без изменений все блоки берутся из кэша
+        mapped = 0;
+        stats = run("v1", mapped);
+        CHECK(cache_hits(stats) == blocks);
+        CHECK(phase_tasks(stats, "map") == 0);
+        CHECK(mapped == 0);
+        CHECK(read_counts(output) == count_lines(lines));
+
+        //строка той же длины в середине входа меняет один блок, остальные - попадания
+        auto changed = lines;
+        changed[changed.size() / 2] = std::string(changed[changed.size() / 2].size(), 'x');
+        write_lines(input, changed);
+        mapped = 0;
+        stats = run("v1", mapped);
+        CHECK(cache_hits(stats) == blocks - 1);
+        CHECK(phase_tasks(stats, "map") == 1);
+        CHECK(mapped > 0 && mapped < lines.size() / 2);
+        CHECK(read_counts(output) == count_lines(changed));
+
+        //другая версия задачи - промах по всем блокам
+        mapped = 0;
+        stats = run("v2", mapped);
+        CHECK(cache_hits(stats) == 0);
+        CHECK(mapped == changed.size());
+        CHECK(read_counts(output) == count_lines(changed));
+    }
+}
+
+int main()
+{
+    auto dir = std::filesystem::absolute("job_control_test_data");
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    auto lines = make_lines(20000);
+    auto input = dir / "input.txt";
+    write_lines(input, lines);
+    auto expected = count_lines(lines);
+
+    test_retry(dir, input, expected);
+    test_cancellation(dir, input, expected);
+    test_map_cache(dir, lines);
+
+    std::filesystem::remove_all(dir);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+/**
+ * Стресс-тест конвейерного выполнения (MapReduce::set_pipelined).
+ *
+ * Конфигурация как в main.cpp - shuffle в памяти, combiner, разбиение диапазонами, - но с сотнями блоков
+ * и разделов, так что файлы мапперов, промежуточные слияния и запуск редьюсеров постоянно пересекаются.
+ * Каждый запуск сравнивается с подсчётом строк в одном потоке: после sort проход fold_partitions должен
+ * выдать все строки ровно один раз по возрастанию и с верным числом повторов, после run - тот же текст.
+ */
+#include "MapReduce.h"
+#include "Check.h"
+
+#include <map>
+#include <random>
+
+namespace
+{
+    using CountMapReduce = MapReduce<std::string, int>;
+    using Record = CountMapReduce::Record;
+
+    // Строки с длинными общими префиксами и повторами: слияния с combiner сворачивают одинаковые ключи
+    std::vector<std::string> make_lines(size_t count, size_t distinct)
+    {
+        std::mt19937_64 random(42);
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < distinct; ++i)
+        {
+            std::string key = random() % 3 == 0 ? "user.name." : "u";
+            auto length = 1 + random() % 24;
+            for (size_t j = 0; j < length; ++j)
+                key.push_back(static_cast<char>('a' + random() % 26));
+            keys.push_back(key);
+        }
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < count; ++i)
+            lines.push_back(keys[random() % keys.size()]);
+        return lines;
+    }
+
+    void configure(CountMapReduce& mr, size_t merge_factor)
+    {
+        mr.set_pipelined(true, merge_factor);
+        mr.set_mapper([](std::string_view line) { return std::pair{ line, 1 }; });
+        mr.set_combiner(std::plus<int>());
+        mr.set_range_partitioning(true);
+        mr.set_reducer([](const std::string& key, CountMapReduce::Values& values, CountMapReduce::Output& output)
+        {
+            int sum = 0;
+            for (auto value : values)
+                sum += value;
+            output.emit(key, sum);
+        });
+    }
+
+    void check_sorted(CountMapReduce& mr, const std::map<std::string, int>& expected)
+    {
+        auto partitions = mr.fold_partitions<std::vector<Record>>([](std::vector<Record>& records, const Record& record)
+        {
+            records.push_back(record);
+        });
+        std::vector<Record> all;
+        for (auto& records : partitions)
+            all.insert(all.end(), records.begin(), records.end());
+        CHECK(all == std::vector<Record>(expected.begin(), expected.end()));
+    }
+}
+
+int main()
+{
+    auto dir = std::filesystem::absolute("pipeline_stress_data");
+    std::filesystem::create_directories(dir);
+    auto input = dir / "input.txt";
+    auto lines = make_lines(20000, 3000);
+    write_lines(input, lines);
+
+    std::map<std::string, int> expected;
+    for (const auto& line : lines)
+        ++expected[line];
+    std::string expected_text;
+    for (const auto& [key, count] : expected)
+        expected_text += key + "\t" + std::to_string(count) + "\n";
+
+    auto pool = std::make_shared<ThreadPool>(8);
+    for (size_t iteration = 0; iteration < 8; ++iteration)
+    {
+        //50 * 4 блоков и 25 * 4 разделов: 20000 файлов мапперов на запуск
+        auto store = std::make_shared<ShuffleStore>(CountMapReduce::default_spill_threshold);
+        CountMapReduce mr(50, 25, pool, store);
+        mr.set_scratch_directory(dir);
+        mr.set_min_block_size(1);
+        configure(mr, iteration % 2 == 0 ? 2 : 8);
+
+        mr.sort(input);
+        check_sorted(mr, expected);
+
+        auto output = dir / "output.txt";
+        mr.run(input, output);
+        CHECK(read_file(output) == expected_text);
+    }
+
+    std::filesystem::remove_all(dir);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+/**
+ * Сортировка и слияние: KeySort.h, LoserTree и MergedReader из ExternalMergeSort.h, RangePartitioner.h.
+ *
+ * Результаты сравниваются с std::stable_sort и std::merge на случайных данных,
+ * в том числе с пустыми источниками, одинаковыми ключами и ключами с нулевыми и старшими байтами.
+ */
+#include "ExternalMergeSort.h"
+#include "KeySort.h"
+#include "RangePartitioner.h"
+#include "Serializer.h"
+#include "Check.h"
+
+#include <random>
+
+namespace
+{
+    using Record = std::pair<std::string, int>;
+
+    struct VectorSource
+    {
+        std::vector<Record> records;
+        size_t position = 0;
+
+        bool read(Record& record)
+        {
+            if (position == records.size())
+                return false;
+            record = records[position++];
+            return true;
+        }
+    };
+
+    std::string make_key(std::mt19937_64& random, size_t max_length, std::string_view alphabet)
+    {
+        std::string key;
+        auto length = random() % (max_length + 1);
+        for (size_t i = 0; i < length; ++i)
+            key.push_back(alphabet[random() % alphabet.size()]);
+        return key;
+    }
+
+    void test_key_sort()
+    {
+        std::mt19937_64 random(11);
+        ThreadPool pool(3);
+        const std::string_view alphabets[] = { std::string_view("\0\1a\x7f\x80\xff", 6), "ab", "abcdefghijklmnopqrstuvwxyz" };
+        for (size_t i = 0; i < 200; ++i)
+        {
+            auto count = i < 190 ? random() % 300 : random() % 50000;
+            //ключи до 20 байт: совпадения префиксов на глубине 8 и 16 досортировываются следующими словами
+            std::vector<Record> records;
+            for (size_t j = 0; j < count; ++j)
+                records.emplace_back(make_key(random, 20, alphabets[i % 3]), static_cast<int>(j));
+
+            auto expected = records;
+            std::stable_sort(expected.begin(), expected.end(), KeyLess<std::string, int>());
+            sort_records(records, KeyLess<std::string, int>(), i % 2 == 0 ? &pool : nullptr);
+            //порядок равных ключей не гарантируется, поэтому сравниваются ключи и набор значений
+            for (size_t j = 0; j < count; ++j)
+                CHECK(records[j].first == expected[j].first);
+            std::sort(records.begin(), records.end());
+            std::sort(expected.begin(), expected.end());
+            CHECK(records == expected);
+        }
+
+        //нестроковые ключи - через std::sort
+        std::vector<std::pair<int, int>> numbers;
+        for (int i = 0; i < 1000; ++i)
+            numbers.emplace_back(static_cast<int>(random() % 100) - 50, i);
+        auto expected = numbers;
+        std::stable_sort(expected.begin(), expected.end(), KeyLess<int, int>());
+        sort_records(numbers, KeyLess<int, int>());
+        for (size_t i = 0; i < numbers.size(); ++i)
+            CHECK(numbers[i].first == expected[i].first);
+    }
+
+    void test_merge()
+    {
+        std::mt19937_64 random(13);
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            auto sources_count = random() % 20;
+            std::vector<VectorSource> sources(sources_count);
+            std::vector<Record> expected;
+            for (size_t source = 0; source < sources_count; ++source)
+            {
+                auto& records = sources[source].records;
+                auto count = random() % (i % 3 == 0 ? 3 : 40);
+                for (size_t j = 0; j < count; ++j)
+                    records.emplace_back(make_key(random, 2, "abc"), static_cast<int>(source));
+                std::stable_sort(records.begin(), records.end(), KeyLess<std::string, int>());
+
+                //слияние устойчиво: при равных ключах раньше идёт источник с меньшим номером, как у std::merge
+                std::vector<Record> merged;
+                std::merge(expected.begin(), expected.end(), records.begin(), records.end(), std::back_inserter(merged),
+                           KeyLess<std::string, int>());
+                expected.swap(merged);
+            }
+
+            //LoserTree отдаёт и номер источника минимума
+            {
+                LoserTree<Record, VectorSource, KeyLess<std::string, int>> tree(sources);
+                for (const auto& record : expected)
+                {
+                    CHECK(!tree.empty());
+                    CHECK(tree.top() == record);
+                    CHECK(tree.top_source() == static_cast<size_t>(record.second));
+                    tree.pop();
+                }
+                CHECK(tree.empty());
+            }
+
+            MergedReader<Record, VectorSource, KeyLess<std::string, int>> reader(sources);
+            std::vector<Record> merged;
+            for (Record record; reader.read(record);)
+                merged.push_back(record);
+            CHECK(merged == expected);
+            CHECK(reader.consumed_count() == expected.size());
+
+            //с combine равные ключи сворачиваются в один элемент
+            MergedReader<Record, VectorSource, KeyLess<std::string, int>> combined(sources, [](Record& accumulated, const Record& next)
+            {
+                if (accumulated.first != next.first)
+                    return false;
+                accumulated.second += next.second;
+                return true;
+            });
+            std::vector<Record> folded;
+            for (const auto& record : expected)
+            {
+                if (!folded.empty() && folded.back().first == record.first)
+                    folded.back().second += record.second;
+                else
+                    folded.push_back(record);
+            }
+            merged.clear();
+            for (Record record; combined.read(record);)
+                merged.push_back(record);
+            CHECK(merged == folded);
+            CHECK(combined.consumed_count() == expected.size());
+        }
+    }
+
+    void test_range_partitioner()
+    {
+        std::mt19937_64 random(17);
+        std::vector<std::string> samples;
+        for (size_t i = 0; i < 1000; ++i)
+            samples.push_back(make_key(random, 6, "abcdefgh"));
+
+        //разделы упорядочены: номер раздела не убывает с ключом
+        RangePartitioner<std::string> partitioner;
+        partitioner.build(samples, 10, false);
+        auto keys = samples;
+        std::sort(keys.begin(), keys.end());
+        size_t spread = 0, previous = 0;
+        std::vector<size_t> sizes(10);
+        for (const auto& key : keys)
+        {
+            auto partition = partitioner(key, spread);
+            CHECK(partition < 10);
+            CHECK(partition >= previous);
+            CHECK(partitioner(std::string_view(key), spread) == partition);
+            previous = partition;
+            ++sizes[partition];
+        }
+        //выборка делится по квантилям: ни один раздел не получает больше трети ключей
+        for (auto size : sizes)
+            CHECK(size < keys.size() / 3);
+
+        //тяжёлый ключ занимает половину выборки: без разделения он в одном разделе,
+        //с разделением - по кругу во всех его разделах, а соседние ключи остаются на своих местах
+        std::vector<std::string> skewed(500, "heavy");
+        for (size_t i = 0; i < 250; ++i)
+        {
+            skewed.push_back("a" + std::to_string(i));
+            skewed.push_back("z" + std::to_string(i));
+        }
+        RangePartitioner<std::string> whole, split;
+        whole.build(skewed, 8, false);
+        split.build(skewed, 8, true);
+
+        std::vector<size_t> heavy_partitions;
+        size_t whole_spread = 0, split_spread = 0;
+        for (size_t i = 0; i < 80; ++i)
+        {
+            auto partition = whole("heavy", whole_spread);
+            CHECK(partition == whole("heavy", whole_spread));
+            heavy_partitions.push_back(split("heavy", split_spread));
+        }
+        std::sort(heavy_partitions.begin(), heavy_partitions.end());
+        auto first = heavy_partitions.front(), last = heavy_partitions.back();
+        CHECK(last - first + 1 >= 3);
+        CHECK(static_cast<size_t>(std::unique(heavy_partitions.begin(), heavy_partitions.end()) - heavy_partitions.begin()) == last - first + 1);
+        CHECK(first <= whole("heavy", whole_spread) && whole("heavy", whole_spread) <= last);
+        CHECK(split("a0", split_spread) <= first);
+        CHECK(split("z0", split_spread) >= last);
+    }
+}
+
+int main()
+{
+    test_key_sort();
+    test_merge();
+    test_range_partitioner();
+    return EXIT_SUCCESS;
+}
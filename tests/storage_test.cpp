@@ -0,0 +1,202 @@
+/**
+ * Промежуточные данные: кодек LzCodec, формат файлов SpillFile.h и хранилище ShuffleStore.
+ *
+ * Кодек проверяется круговым преобразованием на случайных данных разной сжимаемости,
+ * формат - побайтово на известной записи и чтением назад, хранилище - переходом на диск
+ * файла, который не помещается под порог.
+ */
+#include "SpillFile.h"
+#include "Check.h"
+
+#include <random>
+
+namespace
+{
+    using IntSpillIO = SpillIO<std::string, int>;
+
+    // Данные трёх видов: случайные байты, текст из нескольких слов и повторы далеко назад (смещения около 64 КБ)
+    std::string make_data(std::mt19937_64& random, size_t size, int kind)
+    {
+        static const std::string words[] = { "user.name@", "example.com\n", "mapreduce ", "a" };
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (kind == 0)
+                data[i] = static_cast<char>(random());
+            else if (kind == 1)
+            {
+                const auto& word = words[random() % 4];
+                auto count = std::min(word.size(), size - i);
+                data.replace(i, count, word, 0, count);
+                i += count - 1;
+            }
+            else
+                data[i] = i >= 65600 && random() % 2 ? data[i - 65000 - random() % 600] : static_cast<char>('a' + random() % 26);
+        }
+        return data;
+    }
+
+    void test_lz_round_trip()
+    {
+        std::mt19937_64 random(7);
+        LzCodec codec;
+        for (size_t i = 0; i < 300; ++i)
+        {
+            auto size = i < 50 ? i : random() % 200000;
+            auto data = make_data(random, size, static_cast<int>(i % 3));
+            std::string compressed = "prefix";
+            codec.compress(data.data(), data.size(), compressed);
+            CHECK(compressed.compare(0, 6, "prefix") == 0);
+
+            std::string restored;
+            CHECK(LzCodec::decompress(compressed.data() + 6, compressed.size() - 6, restored, data.size()));
+            CHECK(restored == data);
+            if (i % 3 == 1 && size > 1000)
+                CHECK(compressed.size() < data.size() / 2);
+        }
+
+        //обрезанные данные и неверный размер распознаются, а не читаются за границу
+        auto data = make_data(random, 10000, 1);
+        std::string compressed, restored;
+        codec.compress(data.data(), data.size(), compressed);
+        CHECK(!LzCodec::decompress(compressed.data(), compressed.size() / 2, restored, data.size()));
+        CHECK(!LzCodec::decompress(compressed.data(), compressed.size(), restored, data.size() + 1));
+    }
+
+    void test_spill_format(const std::filesystem::path& dir)
+    {
+        //заголовок блока, затем длины (varint) и байты ключа и значения
+        auto fname = (dir / "format").string();
+        SpillWriter writer(fname);
+        writer.write("key", std::string(200, 'v'));
+        writer.close();
+
+        auto bytes = read_file(fname);
+        uint32_t raw_size, stored_size;
+        std::memcpy(&raw_size, bytes.data(), sizeof(raw_size));
+        std::memcpy(&stored_size, bytes.data() + sizeof(raw_size), sizeof(stored_size));
+        CHECK(raw_size == 1 + 3 + 2 + 200);
+        CHECK(stored_size == raw_size);
+        CHECK(bytes[2 * sizeof(uint32_t)] == spill::codec_none);
+        CHECK(bytes.size() == spill::header_size + raw_size);
+        auto record = bytes.substr(spill::header_size);
+        CHECK(record.compare(0, 4, "\x03key") == 0);
+        CHECK(static_cast<uint8_t>(record[4]) == (200 | 0x80) && record[5] == 1);
+
+        //обрезанный файл - ошибка, а не молча потерянные записи
+        std::filesystem::resize_file(fname, bytes.size() - 1);
+        SpillReader truncated(fname);
+        std::string_view key, value;
+        bool failed = false;
+        try
+        {
+            truncated.next(key, value);
+        }
+        catch (const std::runtime_error&)
+        {
+            failed = true;
+        }
+        CHECK(failed);
+
+        //ключи и значения с любыми байтами, много блоков, со сжатием и без
+        for (bool compress : { false, true })
+        {
+            IntSpillIO io{ compress };
+            auto records_name = (dir / "records").string();
+            auto out = io.open_writer(records_name);
+            for (int i = 0; i < 50000; ++i)
+                out.write(std::string("key\n\t ") + std::string(1, '\0') + std::to_string(i % 1000), i);
+            out.close();
+
+            auto in = io.open_reader(records_name);
+            IntSpillIO::Record record;
+            int count = 0;
+            for (; in.read(record); ++count)
+            {
+                CHECK(record.first == std::string("key\n\t ") + std::string(1, '\0') + std::to_string(count % 1000));
+                CHECK(record.second == count);
+            }
+            CHECK(count == 50000);
+            if (compress)
+                CHECK(io.size(records_name) < 50000 * 8);
+        }
+
+        //без close файл не появляется, временный файл не остаётся
+        auto discarded = dir / "discarded";
+        {
+            SpillWriter unfinished(discarded.string());
+            unfinished.write("key", "value");
+        }
+        CHECK(!std::filesystem::exists(discarded));
+        CHECK(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()) == 2);
+    }
+
+    void test_shuffle_store(const std::filesystem::path& dir)
+    {
+        ShuffleStore store(64 * 1024);
+        IntSpillIO io{ false, &store };
+
+        auto write = [&io](const std::string& fname, int count)
+        {
+            auto out = io.open_writer(fname);
+            for (int i = 0; i < count; ++i)
+                out.write("key" + std::to_string(i), i);
+            out.close();
+        };
+        auto check_records = [&io](const std::string& fname, int count)
+        {
+            auto in = io.open_reader(fname);
+            IntSpillIO::Record record;
+            int read = 0;
+            for (; in.read(record); ++read)
+                CHECK(record.first == "key" + std::to_string(read) && record.second == read);
+            CHECK(read == count);
+        };
+
+        //под порогом - только в памяти
+        auto small = (dir / "small").string();
+        write(small, 100);
+        CHECK(store.find(small) != nullptr);
+        CHECK(!std::filesystem::exists(small));
+        auto used = store.used_bytes();
+        CHECK(used == io.size(small));
+
+        //не помещается - на диск, занятое под него место возвращается
+        auto large = (dir / "large").string();
+        write(large, 20000);
+        CHECK(store.find(large) == nullptr);
+        CHECK(std::filesystem::exists(large));
+        CHECK(store.used_bytes() == used);
+        check_records(small, 100);
+        check_records(large, 20000);
+
+        //перезапись сегмента файлом не оставляет старый сегмент, и наоборот
+        write(small, 20000);
+        CHECK(store.find(small) == nullptr);
+        CHECK(store.used_bytes() == 0);
+        check_records(small, 20000);
+        write(large, 100);
+        CHECK(store.find(large) != nullptr);
+        CHECK(!std::filesystem::exists(large));
+        check_records(large, 100);
+
+        io.remove(small);
+        io.remove(large);
+        CHECK(!io.exists(small) && !io.exists(large));
+        CHECK(store.used_bytes() == 0);
+    }
+}
+
+int main()
+{
+    auto dir = std::filesystem::absolute("storage_test_data");
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    test_lz_round_trip();
+    test_spill_format(dir);
+    test_shuffle_store(dir);
+
+    std::filesystem::remove_all(dir);
+    return EXIT_SUCCESS;
+}